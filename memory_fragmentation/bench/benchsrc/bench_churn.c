@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "myMalloc.h"
+
+#define ROUNDS 1000000
+#define LIVE 64
+
+static size_t sizes[] = {8, 32, 64, 128};
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Free and immediately reallocate a block of the same size, the
+ *        pattern quick lists turn into a pop and a push
+ *
+ * @return Nanoseconds per allocation and free pair
+ */
+static double same_size(size_t size) {
+  void * live[LIVE];
+  for (int i = 0; i < LIVE; i++) {
+    live[i] = my_malloc(size);
+  }
+
+  double start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    int slot = r % LIVE;
+    my_free(live[slot]);
+    live[slot] = my_malloc(size);
+  }
+  double elapsed = now_ns() - start;
+
+  for (int i = 0; i < LIVE; i++) {
+    my_free(live[i]);
+  }
+  return elapsed / ROUNDS;
+}
+
+/**
+ * @brief Free and reallocate blocks of randomly mixed small sizes
+ *
+ * @return Nanoseconds per allocation and free pair
+ */
+static double mixed_sizes() {
+  void * live[LIVE];
+  unsigned int seed = 1;
+  for (int i = 0; i < LIVE; i++) {
+    live[i] = my_malloc(sizes[rand_r(&seed) % NSIZES]);
+  }
+
+  double start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    int slot = rand_r(&seed) % LIVE;
+    my_free(live[slot]);
+    live[slot] = my_malloc(sizes[rand_r(&seed) % NSIZES]);
+  }
+  double elapsed = now_ns() - start;
+
+  for (int i = 0; i < LIVE; i++) {
+    my_free(live[i]);
+  }
+  return elapsed / ROUNDS;
+}
+
+int main() {
+  printf("quick lists: %d, guard sample rate: %d, ns per free+alloc pair\n",
+         N_QUICK_LISTS, GUARD_SAMPLE_RATE);
+  for (size_t i = 0; i < NSIZES; i++) {
+    printf("%8zu %12.1f\n", sizes[i], same_size(sizes[i]));
+  }
+  printf("%8s %12.1f\n", "mixed", mixed_sizes());
+}
@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "myMalloc.h"
+
+#define NBLOCKS MAX_HANDLES
+#define KEEP_ONE_IN 8
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Resident set size of the process in bytes
+ */
+static size_t rss() {
+  size_t pages = 0, resident = 0;
+  FILE * f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%zu %zu", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(f);
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+static uint32_t xorshift(uint32_t * state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static void row(const char * step, double ms) {
+  printf("%-28s %10.1f %10.2f\n", step, rss() / 1048576.0, ms);
+}
+
+int main() {
+  static my_handle handles[NBLOCKS];
+  static size_t sizes[NBLOCKS];
+  uint32_t state = 2463534242u;
+
+  printf("%-28s %10s %10s\n", "step", "RSS MiB", "ms");
+  row("start", 0);
+
+  double start = now_ns();
+  for (int i = 0; i < NBLOCKS; i++) {
+    sizes[i] = 64 + xorshift(&state) % 960;
+    handles[i] = my_halloc(sizes[i]);
+    memset(my_hpin(handles[i]), (char) i, sizes[i]);
+    my_hunpin(handles[i]);
+  }
+  row("allocated", (now_ns() - start) / 1e6);
+
+  // Keep a scattered few blocks alive so every page still holds some data
+  start = now_ns();
+  for (int i = 0; i < NBLOCKS; i++) {
+    if (xorshift(&state) % KEEP_ONE_IN) {
+      my_hfree(handles[i]);
+      handles[i] = NULL;
+    }
+  }
+  row("freed 7 in 8", (now_ns() - start) / 1e6);
+
+  start = now_ns();
+  my_malloc_trim();
+  row("my_malloc_trim", (now_ns() - start) / 1e6);
+
+  start = now_ns();
+  size_t moved = my_compact();
+  row("my_compact", (now_ns() - start) / 1e6);
+
+  size_t intact = 0, live = 0;
+  for (int i = 0; i < NBLOCKS; i++) {
+    if (handles[i]) {
+      char * p = my_hpin(handles[i]);
+      intact += p[0] == (char) i && p[sizes[i] - 1] == (char) i;
+      live++;
+      my_hunpin(handles[i]);
+    }
+  }
+  printf("%zu blocks moved, %zu of %zu live blocks intact\n", moved, intact, live);
+}
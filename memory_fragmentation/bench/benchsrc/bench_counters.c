@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "myMalloc.h"
+#include "perf_counters.h"
+
+#define NSLOTS 16384
+#define NCHURN 400000
+
+#if SIZE_CLASSES == SIZE_CLASSES_GEOMETRIC
+#define CLASSES_NAME "geometric"
+#else
+#define CLASSES_NAME "linear"
+#endif
+
+#if FIT_POLICY == FIT_BEST
+#define POLICY_NAME "best"
+#elif FIT_POLICY == FIT_NEXT
+#define POLICY_NAME "next"
+#elif FIT_POLICY == FIT_GOOD
+#define POLICY_NAME "good"
+#else
+#define POLICY_NAME "first"
+#endif
+
+static void * ptrs[NSLOTS];
+
+static uint32_t xorshift(uint32_t * state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/* Mostly small requests with the occasional large one */
+static size_t next_size(uint32_t * state) {
+  uint32_t r = xorshift(state);
+  return r % 10 ? 16 + r % 256 : 1024 + r % 16384;
+}
+
+/*
+ * The phases of a run. Fill allocates every slot, churn frees a random slot
+ * and refills it, and drain frees everything that is left.
+ */
+static int fill(uint32_t * state) {
+  for (int i = 0; i < NSLOTS; i++) {
+    ptrs[i] = my_malloc(next_size(state));
+  }
+  return NSLOTS;
+}
+
+static int churn(uint32_t * state) {
+  for (int op = 0; op < NCHURN; op++) {
+    size_t slot = xorshift(state) % NSLOTS;
+    my_free(ptrs[slot]);
+    ptrs[slot] = my_malloc(next_size(state));
+  }
+  return NCHURN;
+}
+
+static int drain(uint32_t * state) {
+  (void) state;
+  for (int i = 0; i < NSLOTS; i++) {
+    my_free(ptrs[i]);
+    ptrs[i] = NULL;
+  }
+  return NSLOTS;
+}
+
+static const struct {
+  const char * name;
+  int (*run)(uint32_t * state);
+} phases[] = {
+  { "fill", fill },
+  { "churn", churn },
+  { "drain", drain },
+};
+#define NPHASES (sizeof(phases) / sizeof(phases[0]))
+
+/**
+ * @brief Run every phase on an empty heap and print the run as one line of
+ *        JSON, the build configuration first so runs of different builds can
+ *        be told apart when diffed
+ */
+static void run(int index) {
+  perf_counters c;
+  counters_open(&c);
+  uint32_t state = 2463534242u;
+
+  printf("{\"bench\": \"counters\", \"run\": %d, \"config\": {\"arena_size\": %d, "
+         "\"n_lists\": %d, \"n_quick_lists\": %d, \"size_classes\": \"%s\", "
+         "\"fit_policy\": \"%s\", \"malloc_alignment\": %d}, \"phases\": {",
+         index, ARENA_SIZE, N_LISTS, N_QUICK_LISTS, CLASSES_NAME, POLICY_NAME,
+         MALLOC_ALIGNMENT);
+  for (size_t i = 0; i < NPHASES; i++) {
+    counters_start(&c);
+    int ops = phases[i].run(&state);
+    counters_stop(&c);
+    printf("%s\"%s\": {\"ops\": %d, \"ns_per_op\": %.1f, \"stats\": ",
+           i ? ", " : "", phases[i].name, ops, c.ns / ops);
+    counters_print_json(&c, stdout);
+    printf("}");
+  }
+
+  alloc_stats stats;
+  my_malloc_stats(&stats);
+  printf("}, \"heap_bytes\": %zu}\n", stats.heap_bytes);
+  counters_close(&c);
+}
+
+int main(int argc, char ** argv) {
+  int runs = argc > 1 ? atoi(argv[1]) : 1;
+
+  // Each run is a child so it starts from an empty heap
+  for (int i = 0; i < runs; i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(i);
+      exit(0);
+    }
+    waitpid(pid, NULL, 0);
+  }
+}
@@ -0,0 +1,83 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "myMalloc.h"
+
+#define N_THREADS 4
+#define INCREMENTS 50000000
+
+static pthread_barrier_t barrier;
+static void * (*allocate)(size_t size);
+static volatile uint64_t * counters[N_THREADS];
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Allocate a counter in turn with the other threads, so counters from
+ *        a packed heap are neighbors, then increment it
+ */
+static void * run(void * arg) {
+  int id = (int) (intptr_t) arg;
+  for (int turn = 0; turn < N_THREADS; turn++) {
+    if (turn == id) {
+      counters[id] = allocate(sizeof(uint64_t));
+      *counters[id] = 0;
+    }
+    pthread_barrier_wait(&barrier);
+  }
+  volatile uint64_t * counter = counters[id];
+  for (int i = 0; i < INCREMENTS; i++) {
+    (*counter)++;
+  }
+  return NULL;
+}
+
+static void row(const char * name, void * (*alloc)(size_t size)) {
+  allocate = alloc;
+  pthread_t threads[N_THREADS];
+  double start = now_ns();
+  for (int i = 0; i < N_THREADS; i++) {
+    pthread_create(&threads[i], NULL, run, (void *) (intptr_t) i);
+  }
+  for (int i = 0; i < N_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double elapsed = now_ns() - start;
+
+  // Count the counters sharing a line with another thread's counter
+  int shared = 0;
+  for (int i = 0; i < N_THREADS; i++) {
+    for (int j = 0; j < N_THREADS; j++) {
+      if (i != j && (uintptr_t) counters[i] / CACHE_LINE_SIZE ==
+                    (uintptr_t) counters[j] / CACHE_LINE_SIZE) {
+        shared++;
+        break;
+      }
+    }
+  }
+  printf("%-20s %14.2f %8d\n", name, elapsed / INCREMENTS, shared);
+  for (int i = 0; i < N_THREADS; i++) {
+    my_free((void *) counters[i]);
+  }
+}
+
+int main() {
+  pthread_barrier_init(&barrier, NULL, N_THREADS);
+  printf("%d threads, %d increments each\n", N_THREADS, INCREMENTS);
+  printf("%-20s %14s %8s\n", "allocation", "ns/increment", "shared");
+#if THREAD_LINES
+  row("thread lines", my_malloc);
+#else
+  row("my_malloc", my_malloc);
+  row("my_malloc_isolated", my_malloc_isolated);
+#endif
+}
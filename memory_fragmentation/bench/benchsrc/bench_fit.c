@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "myMalloc.h"
+
+#define NOPS 400000
+#define NSLOTS 4096
+
+#if SIZE_CLASSES == SIZE_CLASSES_GEOMETRIC
+#define POLICY_NAME "geometric"
+#elif FIT_POLICY == FIT_BEST
+#define POLICY_NAME "best"
+#elif FIT_POLICY == FIT_NEXT
+#define POLICY_NAME "next"
+#elif FIT_POLICY == FIT_GOOD
+#define POLICY_NAME "good"
+#else
+#define POLICY_NAME "first"
+#endif
+
+/*
+ * A trace is a fixed sequence of allocations and frees generated from a seed,
+ * so every policy replays exactly the same requests
+ *
+ * FIELDS
+ * const char * name Name printed for the trace
+ * size_t (*size)(uint32_t r, int op) Size of an allocation from a random
+ *        number and the index of the operation
+ */
+typedef struct trace {
+  const char * name;
+  size_t (*size)(uint32_t r, int op);
+} trace;
+
+static size_t large_mixed(uint32_t r, int op) {
+  (void) op;
+  return 512 + r % 16384;
+}
+
+static size_t bimodal(uint32_t r, int op) {
+  (void) op;
+  return r % 10 ? 16 + r % 256 : 1024 + r % 65536;
+}
+
+static size_t growing(uint32_t r, int op) {
+  return 512 + (size_t) op * 8192 / NOPS + r % 1024;
+}
+
+static trace traces[] = {
+  { "large mixed", large_mixed },
+  { "bimodal", bimodal },
+  { "growing", growing },
+};
+#define NTRACES (sizeof(traces) / sizeof(traces[0]))
+
+static uint32_t xorshift(uint32_t * state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Replay a trace, each operation picks a random slot and frees it if
+ *        it is in use or fills it otherwise
+ */
+static void replay(trace * t) {
+  static void * ptrs[NSLOTS];
+  static size_t sizes[NSLOTS];
+  uint32_t state = 2463534242u;
+  size_t live = 0, peak = 0;
+
+  double start = now_ns();
+  for (int op = 0; op < NOPS; op++) {
+    uint32_t r = xorshift(&state);
+    size_t slot = r % NSLOTS;
+    if (ptrs[slot]) {
+      my_free(ptrs[slot]);
+      ptrs[slot] = NULL;
+      live -= sizes[slot];
+    } else {
+      sizes[slot] = t->size(xorshift(&state), op);
+      ptrs[slot] = my_malloc(sizes[slot]);
+      live += sizes[slot];
+      if (live > peak) {
+        peak = live;
+      }
+    }
+  }
+  double elapsed = now_ns() - start;
+
+  alloc_stats stats;
+  my_malloc_stats(&stats);
+  printf("%-10s %-14s %10.1f %12zu %12zu %8.2f\n", POLICY_NAME, t->name,
+         elapsed / NOPS, peak, stats.heap_bytes, (double) stats.heap_bytes / peak);
+}
+
+int main() {
+  printf("%-10s %-14s %10s %12s %12s %8s\n", "policy", "trace", "ns/op",
+         "peak live", "heap bytes", "ratio");
+
+  // Each trace runs in a child so it starts from an empty heap
+  for (size_t i = 0; i < NTRACES; i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      replay(&traces[i]);
+      exit(0);
+    }
+    waitpid(pid, NULL, 0);
+  }
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "myMalloc.h"
+
+#define NBLOCKS (1 << 17)
+#define FORKS 200
+#define CHILD_FREES 1024
+#define CHILD_MALLOCS 64
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Minor faults taken by all waited for children so far
+ */
+static long child_faults() {
+  struct rusage ru;
+  getrusage(RUSAGE_CHILDREN, &ru);
+  return ru.ru_minflt;
+}
+
+/**
+ * @brief Fork and exec /bin/true FORKS times, optionally freeing inherited
+ *        blocks and building a few strings in the child first like a shell
+ *        does before exec
+ *
+ * @param blocks The parent's live blocks
+ * @param work true to use the heap in the child before exec
+ * @param ns Set to the nanoseconds per fork+exec
+ *
+ * @return Minor faults per fork+exec
+ */
+static double run(char ** blocks, bool work, double * ns) {
+  long faults = child_faults();
+  double start = now_ns();
+  for (int i = 0; i < FORKS; i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      if (work) {
+        // Distinct blocks spread over the whole heap
+        for (int j = 0; j < CHILD_FREES; j++) {
+          my_free(blocks[(j * (NBLOCKS / CHILD_FREES) + i) % NBLOCKS]);
+        }
+        for (int j = 0; j < CHILD_MALLOCS; j++) {
+          strcpy(my_malloc(32), "argument");
+        }
+      }
+      execl("/bin/true", "true", (char *) NULL);
+      _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+  }
+  *ns = (now_ns() - start) / FORKS;
+  return (double) (child_faults() - faults) / FORKS;
+}
+
+int main() {
+  static char * blocks[NBLOCKS];
+  for (int i = 0; i < NBLOCKS; i++) {
+    blocks[i] = my_malloc(256);
+    memset(blocks[i], 1, 256);
+  }
+
+  double ns;
+  printf("fork reset: %d, heap of %d blocks\n", MALLOC_FORK_RESET, NBLOCKS);
+  printf("%-22s %14s %12s\n", "child", "faults/fork", "us/fork");
+  double faults = run(blocks, false, &ns);
+  printf("%-22s %14.1f %12.1f\n", "exec only", faults, ns / 1000);
+  faults = run(blocks, true, &ns);
+  printf("%-22s %14.1f %12.1f\n", "free+malloc then exec", faults, ns / 1000);
+}
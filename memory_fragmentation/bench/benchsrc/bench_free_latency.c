@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "myMalloc.h"
+
+// Small enough to stay in cache, so the time is the work each free does
+// rather than misses on the headers it reads
+#define NBLOCKS 4096
+#define ROUNDS 128
+
+static void * blocks[NBLOCKS];
+static double latencies[NBLOCKS * ROUNDS];
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare(const void * a, const void * b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+int main() {
+  unsigned int seed = 1;
+  size_t n = 0;
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < NBLOCKS; i++) {
+      blocks[i] = my_malloc(16 + rand_r(&seed) % 256);
+    }
+    // Free every other block and then the rest, so the second half of the
+    // frees coalesce with both neighbors
+    for (int pass = 0; pass < 2; pass++) {
+      for (int i = pass; i < NBLOCKS; i += 2) {
+        double start = now_ns();
+        my_free(blocks[i]);
+        latencies[n++] = now_ns() - start;
+      }
+    }
+  }
+
+  double total = 0;
+  for (size_t i = 0; i < n; i++) {
+    total += latencies[i];
+  }
+  qsort(latencies, n, sizeof(latencies[0]), compare);
+  printf("background interval: %d ms, ns per free\n", BACKGROUND_INTERVAL_MS);
+  printf("%10s %10s %10s %10s\n", "mean", "p50", "p99", "p99.9");
+  printf("%10.1f %10.1f %10.1f %10.1f\n", total / n, latencies[n / 2],
+         latencies[n * 99 / 100], latencies[n * 999 / 1000]);
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "myMalloc.h"
+
+#define ROUNDS 64
+
+static size_t sizes[] = {
+  (size_t) 1 << 16, (size_t) 1 << 20, (size_t) 1 << 24, (size_t) 1 << 28,
+  (size_t) 1 << 30, ((size_t) 1 << 31) + 8, ((size_t) 1 << 32) + 8,
+};
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Allocate a block, write one byte per page as a job filling its
+ *        buffer would and free it again
+ *
+ * @return Nanoseconds for the allocation and free alone, or a negative
+ *         value if the allocation failed
+ */
+static double alloc_touch_free(size_t size, size_t stride) {
+  double start = now_ns();
+  char * p = my_malloc(size);
+  if (!p) {
+    return -1;
+  }
+  double alloced = now_ns();
+  for (size_t i = 0; i < size; i += stride) {
+    p[i] = 1;
+  }
+  double touched = now_ns();
+  my_free(p);
+  return (alloced - start) + (now_ns() - touched);
+}
+
+int main() {
+  printf("ns per malloc+free pair, excluding page faults\n");
+  printf("%14s %14s %14s\n", "size", "untouched", "every 64 pages");
+  for (size_t i = 0; i < NSIZES; i++) {
+    double cold = 0, warm = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+      cold += alloc_touch_free(sizes[i], sizes[i]);
+      warm += alloc_touch_free(sizes[i], 64 * 4096);
+    }
+    printf("%14zu %14.0f %14.0f\n", sizes[i], cold / ROUNDS, warm / ROUNDS);
+  }
+}
@@ -0,0 +1,67 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lock.h"
+#include "myMalloc.h"
+
+#define OPS 200000
+#define LIVE 64
+#define MAX_THREADS 8
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Keep LIVE small objects alive and replace one on every operation
+ *        so that each critical section is short
+ */
+static void * churn(void * arg) {
+  unsigned int seed = (unsigned int) (long) arg;
+  void * live[LIVE] = {0};
+  for (int i = 0; i < OPS; i++) {
+    int slot = rand_r(&seed) % LIVE;
+    my_free(live[slot]);
+    live[slot] = my_malloc(8 + 8 * (rand_r(&seed) % 8));
+  }
+  for (int i = 0; i < LIVE; i++) {
+    my_free(live[i]);
+  }
+  return NULL;
+}
+
+int main() {
+  printf("lock: %s\n", MALLOC_LOCK == MALLOC_LOCK_FUTEX ? "futex" : "pthread");
+  printf("%8s %10s %14s %12s %16s\n", "threads", "ns/op", "acquisitions",
+         "contended", "wait cycles/op");
+
+  for (int nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+    alloc_stats before, after;
+    my_malloc_stats(&before);
+
+    pthread_t threads[MAX_THREADS];
+    double start = now_ns();
+    for (long t = 0; t < nthreads; t++) {
+      pthread_create(&threads[t], NULL, churn, (void *) (t + 1));
+    }
+    for (int t = 0; t < nthreads; t++) {
+      pthread_join(threads[t], NULL);
+    }
+    double elapsed = now_ns() - start;
+
+    my_malloc_stats(&after);
+    size_t acquisitions = after.lock_acquisitions - before.lock_acquisitions;
+    size_t contended = after.lock_contended - before.lock_contended;
+    uint64_t cycles = after.lock_wait_cycles - before.lock_wait_cycles;
+    printf("%8d %10.1f %14zu %12zu %16.1f\n", nthreads,
+           elapsed / ((double) OPS * nthreads), acquisitions, contended,
+           (double) cycles / acquisitions);
+  }
+}
@@ -0,0 +1,87 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "myMalloc.h"
+#include "pool.h"
+
+#define BATCH 1024
+#define ROUNDS 256
+#define NTHREADS 4
+
+static size_t sizes[] = {16, 32, 64, 128, 256};
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static my_pool * pools[NSIZES];
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Allocate BATCH objects and free them all ROUNDS times through
+ *        either a pool or my_malloc
+ *
+ * @param arg Index into sizes, negated (minus one) to use my_malloc
+ */
+static void * churn(void * arg) {
+  long idx = (long) arg;
+  bool use_pool = idx >= 0;
+  if (!use_pool) {
+    idx = -idx - 1;
+  }
+
+  void * objs[BATCH];
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < BATCH; i++) {
+      objs[i] = use_pool ? my_pool_alloc(pools[idx]) : my_malloc(sizes[idx]);
+    }
+    for (int i = 0; i < BATCH; i++) {
+      if (use_pool) {
+        my_pool_free(pools[idx], objs[i]);
+      } else {
+        my_free(objs[i]);
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Time the churn workload on nthreads threads
+ *
+ * @return Nanoseconds per allocation and free pair
+ */
+static double run(long arg, int nthreads) {
+  pthread_t threads[NTHREADS];
+  double start = now_ns();
+  for (int t = 0; t < nthreads; t++) {
+    pthread_create(&threads[t], NULL, churn, (void *) arg);
+  }
+  for (int t = 0; t < nthreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  return (now_ns() - start) / ((double) BATCH * ROUNDS * nthreads);
+}
+
+int main() {
+  for (size_t i = 0; i < NSIZES; i++) {
+    pools[i] = my_pool_create(sizes[i], 0);
+  }
+
+  for (int nthreads = 1; nthreads <= NTHREADS; nthreads *= NTHREADS) {
+    printf("%d thread(s), ns per alloc+free pair\n", nthreads);
+    printf("%8s %12s %12s %10s\n", "size", "my_malloc", "my_pool", "speedup");
+    for (size_t i = 0; i < NSIZES; i++) {
+      double m = run(-(long) i - 1, nthreads);
+      double p = run((long) i, nthreads);
+      printf("%8zu %12.1f %12.1f %9.1fx\n", sizes[i], m, p, m / p);
+    }
+    puts("");
+  }
+}
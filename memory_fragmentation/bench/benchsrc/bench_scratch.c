@@ -0,0 +1,103 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "myMalloc.h"
+#include "scratch.h"
+
+#define ROUNDS 200000
+#define DEPTH 8
+
+/*
+ * Sizes of the buffers at each level of nesting, like the regex and name
+ * buffers built while expanding a wildcard one directory at a time
+ */
+static size_t sizes[DEPTH] = { 1024, 40, 2048, 24, 512, 64, 256, 16 };
+
+/*
+ * Every buffer is stored here so the compiler cannot pair up and remove a
+ * malloc and its free
+ */
+static char * volatile escape;
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static size_t nest_malloc(int level) {
+  if (level == DEPTH) {
+    return 0;
+  }
+  char * buf = malloc(sizes[level]);
+  buf[0] = (char) level;
+  escape = buf;
+  size_t n = buf[0] + nest_malloc(level + 1);
+  free(buf);
+  return n;
+}
+
+static size_t nest_my_malloc(int level) {
+  if (level == DEPTH) {
+    return 0;
+  }
+  char * buf = my_malloc(sizes[level]);
+  buf[0] = (char) level;
+  escape = buf;
+  size_t n = buf[0] + nest_my_malloc(level + 1);
+  my_free(buf);
+  return n;
+}
+
+static size_t nest_scratch(int level) {
+  if (level == DEPTH) {
+    return 0;
+  }
+  void * mark = my_scratch_mark();
+  char * buf = my_scratch_alloc(sizes[level]);
+  buf[0] = (char) level;
+  escape = buf;
+  size_t n = buf[0] + nest_scratch(level + 1);
+  my_scratch_release(mark);
+  return n;
+}
+
+// Every buffer is released at once by the outermost mark
+static size_t nest_scratch_outer(int level) {
+  if (level == DEPTH) {
+    return 0;
+  }
+  char * buf = my_scratch_alloc(sizes[level]);
+  buf[0] = (char) level;
+  escape = buf;
+  return buf[0] + nest_scratch_outer(level + 1);
+}
+
+static void row(const char * name, size_t (*nest)(int level), bool outer_mark) {
+  volatile size_t sink = 0;
+  double start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    void * mark = outer_mark ? my_scratch_mark() : NULL;
+    sink += nest(0);
+    if (outer_mark) {
+      my_scratch_release(mark);
+    }
+  }
+  double elapsed = now_ns() - start;
+  printf("%-26s %12.1f\n", name, elapsed / ROUNDS / DEPTH);
+}
+
+int main() {
+  printf("%d levels of nested buffers\n", DEPTH);
+  printf("%-26s %12s\n", "allocator", "ns/buffer");
+  row("malloc/free", nest_malloc, false);
+  row("my_malloc/my_free", nest_my_malloc, false);
+  row("scratch mark per level", nest_scratch, false);
+  row("scratch outer mark", nest_scratch_outer, true);
+}
@@ -0,0 +1,147 @@
+#include <cstdio>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "myMalloc.hh"
+
+#define ROUNDS 200
+#define ELEMENTS 2000
+
+/*
+ * Result of every workload, kept so the containers are not optimized away
+ */
+static volatile std::size_t sink;
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * A vector of argument strings too long for the small string optimization,
+ * like the argument lists the shell builds for every command
+ */
+struct Strings {
+  template <class A>
+  void operator()(const A & a) const {
+    using CharAlloc = typename std::allocator_traits<A>::template rebind_alloc<char>;
+    using String = std::basic_string<char, std::char_traits<char>, CharAlloc>;
+    using StringAlloc = typename std::allocator_traits<A>::template rebind_alloc<String>;
+    std::vector<String, StringAlloc> args{StringAlloc(a)};
+    for (int i = 0; i < ELEMENTS; i++) {
+      args.emplace_back(16 + i % 64, 'x');
+    }
+    sink = args.size();
+  }
+};
+
+/*
+ * A list that grows and has every other node erased
+ */
+struct Lists {
+  template <class A>
+  void operator()(const A & a) const {
+    using IntAlloc = typename std::allocator_traits<A>::template rebind_alloc<int>;
+    std::list<int, IntAlloc> list{IntAlloc(a)};
+    for (int i = 0; i < ELEMENTS; i++) {
+      list.push_back(i);
+    }
+    for (auto it = list.begin(); it != list.end(); it = list.erase(it)) {
+      if (++it == list.end()) {
+        break;
+      }
+    }
+    sink = list.size();
+  }
+};
+
+/*
+ * A map filled in a scattered order and then emptied
+ */
+struct Maps {
+  template <class A>
+  void operator()(const A & a) const {
+    using Pair = std::pair<const int, int>;
+    using PairAlloc = typename std::allocator_traits<A>::template rebind_alloc<Pair>;
+    std::map<int, int, std::less<int>, PairAlloc> map{PairAlloc(a)};
+    for (int i = 0; i < ELEMENTS; i++) {
+      map[(i * 7919) % ELEMENTS] = i;
+    }
+    for (int i = 0; i < ELEMENTS; i += 2) {
+      map.erase(i);
+    }
+    sink = map.size();
+  }
+};
+
+/*
+ * The backends, each runs a round of a workload with its allocator
+ */
+struct StdBackend {
+  template <class W>
+  void round(W work) {
+    work(std::allocator<char>());
+  }
+};
+
+struct MyAllocatorBackend {
+  template <class W>
+  void round(W work) {
+    work(MyAllocator<char>());
+  }
+};
+
+struct ResourceBackend {
+  std::pmr::memory_resource * resource;
+
+  template <class W>
+  void round(W work) {
+    work(std::pmr::polymorphic_allocator<char>(resource));
+  }
+};
+
+// A region for each round, released all at once when the round ends
+struct MonotonicBackend {
+  template <class W>
+  void round(W work) {
+    std::pmr::monotonic_buffer_resource region(my_malloc_resource());
+    work(std::pmr::polymorphic_allocator<char>(&region));
+  }
+};
+
+template <class B, class W>
+static double time_rounds(B & backend, W work) {
+  double start = now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    backend.round(work);
+  }
+  return (now_ns() - start) / ROUNDS / 1000;
+}
+
+template <class B>
+static void row(const char * name, B backend) {
+  printf("%-22s %10.1f %10.1f %10.1f\n", name, time_rounds(backend, Strings()),
+         time_rounds(backend, Lists()), time_rounds(backend, Maps()));
+}
+
+int main() {
+  // List and map nodes with an int payload all fit in a 64 byte object
+  MyPoolResource pool(64);
+
+  printf("us per round of %d elements\n", ELEMENTS);
+  printf("%-22s %10s %10s %10s\n", "backend", "strings", "list", "map");
+  row("std::allocator", StdBackend());
+  row("MyAllocator", MyAllocatorBackend());
+  row("pmr new_delete", ResourceBackend{std::pmr::new_delete_resource()});
+  row("pmr my_malloc", ResourceBackend{my_malloc_resource()});
+  row("pmr pool", ResourceBackend{&pool});
+  row("pmr monotonic", MonotonicBackend());
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "myMalloc.h"
+
+#define NBLOCKS (1 << 20)
+#define ACCESSES (1 << 24)
+#define CHURN (1 << 21)
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Read the amount of anonymous memory backed by huge pages
+ *
+ * @return Kilobytes of AnonHugePages or -1 if it could not be read
+ */
+static long anon_huge_kb() {
+  FILE * f = fopen("/proc/self/smaps_rollup", "r");
+  if (!f) {
+    return -1;
+  }
+  char line[256];
+  long kb = -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+/**
+ * @brief Random size between 16 and 512 bytes
+ */
+static size_t random_size(unsigned int * seed) {
+  return 16 + rand_r(seed) % 497;
+}
+
+int main() {
+  static char * blocks[NBLOCKS];
+  unsigned int seed = 1;
+
+  // Spread a few hundred MB of blocks over the heap
+  double start = now_ns();
+  for (int i = 0; i < NBLOCKS; i++) {
+    blocks[i] = my_malloc(random_size(&seed));
+    memset(blocks[i], i, 16);
+  }
+  double fill = (now_ns() - start) / NBLOCKS;
+
+  // Touch random blocks, each access is likely to miss the dTLB with 4K pages
+  long sum = 0;
+  start = now_ns();
+  for (int i = 0; i < ACCESSES; i++) {
+    sum += blocks[rand_r(&seed) % NBLOCKS][0];
+  }
+  double access = (now_ns() - start) / ACCESSES;
+
+  // Free and reallocate random blocks so coalescing touches scattered tags
+  start = now_ns();
+  for (int i = 0; i < CHURN; i++) {
+    int slot = rand_r(&seed) % NBLOCKS;
+    my_free(blocks[slot]);
+    blocks[slot] = my_malloc(random_size(&seed));
+  }
+  double churn = (now_ns() - start) / CHURN;
+
+  printf("%-12s %10s %10s %10s %14s\n", "arena", "fill ns", "access ns",
+         "churn ns", "AnonHuge kB");
+  printf("%-12s %10.1f %10.1f %10.1f %14ld\n",
+         ARENA_MMAP ? (ARENA_HUGEPAGES ? "mmap+thp" : "mmap") : "sbrk",
+         fill, access, churn, anon_huge_kb());
+  return sum == 42;
+}
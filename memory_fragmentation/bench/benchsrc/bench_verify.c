@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "myMalloc.h"
+
+#define STEP_CALLS 10000
+
+static size_t heapBlocks[] = { 1000, 10000, 100000, 1000000 };
+#define NHEAPS (sizeof(heapBlocks) / sizeof(heapBlocks[0]))
+
+static size_t budgets[] = { 16, 64, 256 };
+#define NBUDGETS (sizeof(budgets) / sizeof(budgets[0]))
+
+static void * ptrs[1000000];
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main() {
+  size_t live = 0;
+  printf("ns for a full verify() against a my_verify_step call\n");
+  printf("%10s %12s", "blocks", "verify()");
+  for (size_t b = 0; b < NBUDGETS; b++) {
+    printf("   step(%3zu)", budgets[b]);
+  }
+  printf("\n");
+
+  for (size_t h = 0; h < NHEAPS; h++) {
+    // Grow the heap, freeing every fourth block so the freelists are not
+    // empty and the step also checks freelist pointers
+    for (; live < heapBlocks[h]; live++) {
+      ptrs[live] = my_malloc(16 + live % 7 * 8);
+      if (live % 4 == 3) {
+        my_free(ptrs[live - 2]);
+        ptrs[live - 2] = NULL;
+      }
+    }
+
+    double start = now_ns();
+    verify();
+    printf("%10zu %12.0f", live, now_ns() - start);
+
+    for (size_t b = 0; b < NBUDGETS; b++) {
+      start = now_ns();
+      for (int i = 0; i < STEP_CALLS; i++) {
+        my_verify_step(budgets[b]);
+      }
+      printf(" %12.0f", (now_ns() - start) / STEP_CALLS);
+    }
+    printf("\n");
+  }
+}
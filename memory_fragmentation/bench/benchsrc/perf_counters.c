@@ -0,0 +1,138 @@
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "perf_counters.h"
+
+/*
+ * Name of each counter in the JSON output along with the perf event that
+ * counts it
+ */
+static const struct {
+  const char * name;
+  uint32_t type;
+  uint64_t config;
+} events[N_COUNTERS] = {
+  [COUNTER_CYCLES] = { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  [COUNTER_INSTRUCTIONS] = { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  [COUNTER_L1D_MISSES] = { "l1d_misses", PERF_TYPE_HW_CACHE,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  [COUNTER_LLC_MISSES] = { "llc_misses", PERF_TYPE_HW_CACHE,
+    PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  [COUNTER_DTLB_MISSES] = { "dtlb_misses", PERF_TYPE_HW_CACHE,
+    PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  [COUNTER_PAGE_FAULTS] = { "page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+/**
+ * @brief Read a monotonic clock in nanoseconds
+ */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double timeval_us(struct timeval tv) {
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+/**
+ * @brief Open a disabled perf event counting the calling thread in user space
+ *
+ * @return The event or -1 if the kernel does not allow or support it
+ */
+static int open_event(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  // Counting the kernel needs a perf_event_paranoid below 2
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void counters_open(perf_counters * c) {
+  memset(c, 0, sizeof(*c));
+  for (int i = 0; i < N_COUNTERS; i++) {
+    c->fds[i] = open_event(events[i].type, events[i].config);
+    c->perf = c->perf || c->fds[i] >= 0;
+  }
+}
+
+void counters_start(perf_counters * c) {
+  for (int i = 0; i < N_COUNTERS; i++) {
+    if (c->fds[i] >= 0) {
+      ioctl(c->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(c->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  getrusage(RUSAGE_SELF, &c->start);
+  c->start_ns = now_ns();
+}
+
+void counters_stop(perf_counters * c) {
+  c->ns = now_ns() - c->start_ns;
+  struct rusage end;
+  getrusage(RUSAGE_SELF, &end);
+  for (int i = 0; i < N_COUNTERS; i++) {
+    c->valid[i] = false;
+    if (c->fds[i] >= 0) {
+      ioctl(c->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      c->valid[i] = read(c->fds[i], &c->values[i], sizeof(c->values[i])) ==
+                    sizeof(c->values[i]);
+    }
+  }
+
+  c->usage.ru_minflt = end.ru_minflt - c->start.ru_minflt;
+  c->usage.ru_majflt = end.ru_majflt - c->start.ru_majflt;
+  c->usage.ru_nvcsw = end.ru_nvcsw - c->start.ru_nvcsw;
+  c->usage.ru_nivcsw = end.ru_nivcsw - c->start.ru_nivcsw;
+  c->usage.ru_utime.tv_sec = end.ru_utime.tv_sec - c->start.ru_utime.tv_sec;
+  c->usage.ru_utime.tv_usec = end.ru_utime.tv_usec - c->start.ru_utime.tv_usec;
+  c->usage.ru_stime.tv_sec = end.ru_stime.tv_sec - c->start.ru_stime.tv_sec;
+  c->usage.ru_stime.tv_usec = end.ru_stime.tv_usec - c->start.ru_stime.tv_usec;
+
+  // Without perf events page faults are the one counter getrusage has
+  if (!c->valid[COUNTER_PAGE_FAULTS]) {
+    c->values[COUNTER_PAGE_FAULTS] = c->usage.ru_minflt + c->usage.ru_majflt;
+    c->valid[COUNTER_PAGE_FAULTS] = true;
+  }
+}
+
+void counters_close(perf_counters * c) {
+  for (int i = 0; i < N_COUNTERS; i++) {
+    if (c->fds[i] >= 0) {
+      close(c->fds[i]);
+      c->fds[i] = -1;
+    }
+  }
+}
+
+void counters_print_json(perf_counters * c, FILE * out) {
+  fprintf(out, "{\"ns\": %.0f, \"source\": \"%s\", \"counters\": {", c->ns,
+          c->perf ? "perf" : "rusage");
+  for (int i = 0; i < N_COUNTERS; i++) {
+    fprintf(out, "%s\"%s\": ", i ? ", " : "", events[i].name);
+    if (c->valid[i]) {
+      fprintf(out, "%llu", (unsigned long long) c->values[i]);
+    } else {
+      fprintf(out, "null");
+    }
+  }
+  fprintf(out, "}, \"rusage\": {\"user_us\": %.0f, \"sys_us\": %.0f, "
+          "\"minor_faults\": %ld, \"major_faults\": %ld, "
+          "\"voluntary_switches\": %ld, \"involuntary_switches\": %ld}}",
+          timeval_us(c->usage.ru_utime), timeval_us(c->usage.ru_stime),
+          c->usage.ru_minflt, c->usage.ru_majflt, c->usage.ru_nvcsw,
+          c->usage.ru_nivcsw);
+}
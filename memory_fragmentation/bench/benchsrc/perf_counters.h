@@ -0,0 +1,56 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+/* Counters read around each phase of a benchmark */
+enum counter {
+  COUNTER_CYCLES,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_L1D_MISSES,
+  COUNTER_LLC_MISSES,
+  COUNTER_DTLB_MISSES,
+  COUNTER_PAGE_FAULTS,
+  N_COUNTERS,
+};
+
+/*
+ * Counters for one phase. Each counter is a perf event of the calling
+ * thread when the kernel allows it. Counters that could not be opened are
+ * reported as null, and page faults then come from getrusage, which is
+ * always read.
+ *
+ * FIELDS
+ * int fds[] The perf event of each counter or -1
+ * uint64_t values[] The count of each counter over the last phase
+ * bool valid[] Whether each value was counted
+ * bool perf Whether any perf event could be opened
+ * struct rusage start The resource usage when the phase started
+ * struct rusage usage The resource usage over the last phase
+ * double start_ns The time the phase started
+ * double ns The length of the last phase
+ */
+typedef struct perf_counters {
+  int fds[N_COUNTERS];
+  uint64_t values[N_COUNTERS];
+  bool valid[N_COUNTERS];
+  bool perf;
+  struct rusage start;
+  struct rusage usage;
+  double start_ns;
+  double ns;
+} perf_counters;
+
+// Counter interface
+void counters_open(perf_counters * c);
+void counters_start(perf_counters * c);
+void counters_stop(perf_counters * c);
+void counters_close(perf_counters * c);
+
+// Write the last phase as a JSON object
+void counters_print_json(perf_counters * c, FILE * out);
+
+#endif // PERF_COUNTERS_H
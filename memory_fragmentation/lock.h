@@ -0,0 +1,179 @@
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Lock implementations that can be selected with -DMALLOC_LOCK=... */
+#define MALLOC_LOCK_FUTEX 1
+#define MALLOC_LOCK_PTHREAD 2
+
+#ifndef MALLOC_LOCK
+// If not specified at compile time use the spin-then-futex lock on Linux
+#ifdef __linux__
+#define MALLOC_LOCK MALLOC_LOCK_FUTEX
+#else
+#define MALLOC_LOCK MALLOC_LOCK_PTHREAD
+#endif
+#endif
+
+#ifndef MALLOC_LOCK_SPINS
+// Number of times to poll a held lock before sleeping in the kernel
+#define MALLOC_LOCK_SPINS 100
+#endif
+
+/*
+ * Lock protecting allocator state along with contention telemetry
+ *
+ * The futex lock state is 0 when unlocked, 1 when locked and 2 when locked
+ * with threads possibly sleeping on it
+ *
+ * The counters are only written while the lock is held so they need no
+ * atomic operations
+ *
+ * FIELDS
+ * size_t acquisitions Number of times the lock was taken
+ * size_t contended Number of acquisitions that found the lock already held
+ * uint64_t wait_cycles Cycles spent waiting in contended acquisitions
+ */
+typedef struct malloc_lock {
+#if MALLOC_LOCK == MALLOC_LOCK_PTHREAD
+  pthread_mutex_t mutex;
+#else
+  int state;
+#endif
+  size_t acquisitions;
+  size_t contended;
+  uint64_t wait_cycles;
+} malloc_lock;
+
+/**
+ * @brief Read a cycle counter, falling back to nanoseconds where the CPU
+ *        has no user readable counter
+ */
+static inline uint64_t lock_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Hint to the CPU that the thread is in a spin loop
+ */
+static inline void lock_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+static inline void malloc_lock_init(malloc_lock * l) {
+#if MALLOC_LOCK == MALLOC_LOCK_PTHREAD
+  pthread_mutex_init(&l->mutex, NULL);
+#else
+  l->state = 0;
+#endif
+  l->acquisitions = 0;
+  l->contended = 0;
+  l->wait_cycles = 0;
+}
+
+#if MALLOC_LOCK == MALLOC_LOCK_FUTEX
+static inline void futex_wait(int * addr, int val) {
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void futex_wake(int * addr, int n) {
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/**
+ * @brief Slow path of the futex lock, spin briefly and then sleep until
+ *        the holder wakes us
+ *
+ * @param l The lock to acquire
+ */
+static inline void futex_lock_slow(malloc_lock * l) {
+  for (int i = 0; i < MALLOC_LOCK_SPINS; i++) {
+    lock_pause();
+    int c = 0;
+    if (__atomic_load_n(&l->state, __ATOMIC_RELAXED) == 0 &&
+        __atomic_compare_exchange_n(&l->state, &c, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+
+  // Mark the lock as having sleepers so the holder knows to wake one
+  while (__atomic_exchange_n(&l->state, 2, __ATOMIC_ACQUIRE) != 0) {
+    futex_wait(&l->state, 2);
+  }
+}
+#endif
+
+/**
+ * @brief Acquire the lock and record telemetry about the acquisition
+ *
+ * @param l The lock to acquire
+ */
+static inline void malloc_lock_acquire(malloc_lock * l) {
+  bool contended = false;
+  uint64_t start = 0;
+
+#if MALLOC_LOCK == MALLOC_LOCK_PTHREAD
+  if (pthread_mutex_trylock(&l->mutex) != 0) {
+    contended = true;
+    start = lock_cycles();
+    pthread_mutex_lock(&l->mutex);
+  }
+#else
+  int c = 0;
+  if (!__atomic_compare_exchange_n(&l->state, &c, 1, false,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    contended = true;
+    start = lock_cycles();
+    futex_lock_slow(l);
+  }
+#endif
+
+  l->acquisitions++;
+  if (contended) {
+    l->contended++;
+    l->wait_cycles += lock_cycles() - start;
+  }
+}
+
+/**
+ * @brief Release the lock, waking a sleeping waiter if there is one
+ *
+ * @param l The lock to release
+ */
+static inline void malloc_lock_release(malloc_lock * l) {
+#if MALLOC_LOCK == MALLOC_LOCK_PTHREAD
+  pthread_mutex_unlock(&l->mutex);
+#else
+  if (__atomic_exchange_n(&l->state, 0, __ATOMIC_RELEASE) == 2) {
+    futex_wake(&l->state, 1);
+  }
+#endif
+}
+
+#endif // LOCK_H
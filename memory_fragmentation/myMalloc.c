@@ -1,14 +1,23 @@
 #include <errno.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "lock.h"
 #include "myMalloc.h"
+#include "pagemap.h"
+#include "pool.h"
 #include "printing.h"
 
+// Defined by pool.c, which programs that only use my_malloc do not link
+#pragma weak my_pool_magazines_info
+
 /* Due to the way assert() prints error messges we use out own assert function
  * for deteminism when testing assertions
  */
@@ -24,15 +33,115 @@
   #include <assert.h>
 #endif
 
+#if MALLOC_ALIGNMENT != 8 && MALLOC_ALIGNMENT != 16
+#error "MALLOC_ALIGNMENT must be 8 or 16"
+#endif
+
+#if SIZE_CLASSES == SIZE_CLASSES_GEOMETRIC
+/* Number of freelists holding blocks of a single size */
+#define EXACT_LISTS (LINEAR_LISTS < N_LISTS - 1 ? LINEAR_LISTS : N_LISTS - 1)
+#else
+#define EXACT_LISTS (N_LISTS - 1)
+#endif
+
+#if N_QUICK_LISTS >= EXACT_LISTS
+#error "N_QUICK_LISTS must only cover freelists holding a single size"
+#endif
+
+#if FIT_POLICY < FIT_FIRST || FIT_POLICY > FIT_GOOD
+#error "FIT_POLICY must be FIT_FIRST, FIT_BEST, FIT_NEXT or FIT_GOOD"
+#endif
+
+/*
+ * Locks to ensure thread safety, the implementation is selected at compile
+ * time with MALLOC_LOCK
+ *
+ * Locks are always acquired in the order chunkLock, tagLock and then the list
+ * locks in ascending index order
+ */
+
+/*
+ * Lock protecting requests for more memory from the OS along with
+ * lastFencePost, osChunkList and updates to pageMap
+ */
+static malloc_lock chunkLock;
+
+/*
+ * Lock protecting the boundary tags, held while splitting or coalescing
+ * blocks. Allocations that are an exact fit from a freelist do not take it.
+ */
+static malloc_lock tagLock;
+
+/*
+ * A list lock alone on its cache line, the telemetry counters are written on
+ * every acquisition so neighboring locks would otherwise bounce one line
+ * between threads allocating different sizes
+ */
+typedef struct list_lock_line {
+  malloc_lock lock;
+} __attribute__((aligned(CACHE_LINE_SIZE))) list_lock_line;
+
+/*
+ * Locks protecting the freelists and the allocation state of the blocks on
+ * them, each lock covers LISTS_PER_LOCK consecutive lists. Page aligned so the
+ * locks touched by every allocation need as few TLB entries as possible.
+ */
+static list_lock_line listLocks[N_LIST_LOCKS] __attribute__((aligned(4096)));
+
+#if N_QUICK_LISTS > 0
+/*
+ * LIFO stacks of freed blocks that have not been coalesced, indexed like the
+ * freelists and protected by the same list locks. Blocks on a quick list stay
+ * marked as allocated in their boundary tags and are linked through next,
+ * their prev is set to QUICK_MARK so freeing them again can be detected.
+ */
+header * quickLists[N_QUICK_LISTS + 1];
+#define QUICK_MARK ((header *) quickLists)
+
+/*
+ * Total bytes held in the quick lists, updated atomically as different quick
+ * lists are protected by different locks
+ */
+static size_t quickListBytes;
+#endif
+
+/*
+ * A set of list locks held at once, a free needs at most three
+ */
+typedef struct lock_set {
+  malloc_lock * locks[3];
+  int n;
+} lock_set;
+
+/*
+ * Array of sentinel nodes for the freelists, page aligned like listLocks
+ */
+header freelistSentinels[N_LISTS] __attribute__((aligned(4096)));
+
+#if FIT_POLICY == FIT_NEXT
+/*
+ * Block in the last freelist where the next search starts, or NULL to start
+ * at the head. Written while holding the last list's lock and moved on when
+ * the block leaves the list.
+ */
+static header * fitRover;
+#endif
+
 /*
- * Mutex to ensure thread safety for the freelist
+ * Bytes requested from the OS for chunks and the limits set with
+ * my_malloc_set_limit, all protected by chunkLock. The heap only grows in
+ * add_chunk, so allocations served from the freelists never look at them.
  */
-static pthread_mutex_t mutex;
+static size_t heapSize;
+static size_t hardLimit;
+static size_t softLimit;
+static my_malloc_limit_callback limitCallback;
 
 /*
- * Array of sentinel nodes for the freelists
+ * Set while the calling thread handles the soft limit, so allocations made
+ * by the callback do not call it again
  */
-header freelistSentinels[N_LISTS];
+static __thread bool inLimitCallback;
 
 /*
  * Pointer to the second fencepost in the most recently allocated chunk from
@@ -52,29 +161,389 @@ void * base;
 header * osChunkList [MAX_OS_CHUNKS];
 size_t numOsChunks = 0;
 
+/*
+ * A run of contiguous chunks from the OS that have been coalesced, the end
+ * grows when a new chunk is merged into the run
+ */
+typedef struct heap_run {
+  char * start;
+  char * end;
+#if MALLOC_FORK_RESET
+  unsigned generation;
+#endif
+} heap_run;
+
+/*
+ * Map from every page of the heap to the run containing it, used to validate
+ * pointers in constant time. The first and last page of a run may be shared
+ * with memory from another sbrk user so pointers are also checked against
+ * the run's bounds.
+ */
+static page_map pageMap;
+
+#if MALLOC_FORK_RESET
+/*
+ * Incremented in a forked child so runs inherited from the parent can be
+ * told apart from the child's own and are never written to
+ */
+static unsigned heapGeneration = 0;
+#endif
+
+/*
+ * Unused run descriptors carved from pages requested from the OS
+ */
+static heap_run * spareRuns;
+static size_t numSpareRuns = 0;
+
+/*
+ * Position of my_verify_step in the heap, protected by tagLock. Blocks are
+ * only split or coalesced while tagLock is held and a coalesce that absorbs
+ * the block under the cursor moves the cursor to the merged block, so the
+ * cursor always points at the start of a block between calls.
+ *
+ * FIELDS
+ * size_t chunk Index in osChunkList of the chunk being walked
+ * header * block The next block to check or NULL to start the chunk
+ * size_t passes Number of complete passes over the heap
+ */
+typedef struct verify_cursor {
+  size_t chunk;
+  header * block;
+  size_t passes;
+} verify_cursor;
+
+static verify_cursor verifyCursor;
+
+#if VERIFY_EVERY_N_FREES > 0
+/*
+ * Frees left before the calling thread next verifies part of the heap
+ */
+static __thread unsigned verifyCountdown = VERIFY_EVERY_N_FREES;
+#endif
+
+#if BACKGROUND_INTERVAL_MS > 0
+/*
+ * Blocks freed but not yet coalesced, linked through next, along with their
+ * total size. Blocks are pushed without a lock and the whole list is
+ * detached at once under the tag lock. A pending block still looks allocated
+ * so no neighbor coalesces with it, and its prev is set to PENDING_MARK so
+ * freeing it again can be detected.
+ */
+static header * pendingFrees;
+static size_t pendingBytes;
+#define PENDING_MARK ((header *) &pendingFrees)
+
+/*
+ * Milliseconds since the background thread started, advanced by it every
+ * interval. It starts at 1 so a free time of 0 can mark a free block whose
+ * pages have nothing left to purge.
+ */
+static size_t purgeClock = 1;
+#endif
+
+#if GUARD_SAMPLE_RATE > 0
+/*
+ * A slot holding one sampled allocation at the end of its page
+ *
+ * FIELDS
+ * char * ptr The pointer returned to the user
+ * size_t size The size requested by the user
+ * bool allocated Whether the allocation is live, the page is PROT_NONE if not
+ * bool used Whether the slot ever held an allocation
+ */
+typedef struct guard_slot {
+  char * ptr;
+  size_t size;
+  bool allocated;
+  bool used;
+} guard_slot;
+
+/*
+ * Region of 2 * GUARD_SLOTS + 1 pages with a slot in every odd page, each
+ * slot is surrounded by PROT_NONE guard pages
+ */
+static char * guardRegion;
+static size_t guardPageSize;
+static guard_slot guardSlots[GUARD_SLOTS];
+
+/*
+ * Slot the next sampled allocation tries first, slots are used round robin
+ * so a freed slot stays protected for as long as possible
+ */
+static size_t guardNextSlot = 0;
+
+/*
+ * Lock protecting the guard slots
+ */
+static malloc_lock guardLock;
+
+/*
+ * Allocations left before the calling thread samples one, along with the
+ * state of the thread's random number generator
+ */
+static __thread uint32_t guardCountdown;
+static __thread uint32_t guardRandom;
+
+/*
+ * Handler for SIGSEGV installed before the guard region was created
+ */
+static struct sigaction guardPreviousAction;
+#endif
+
+/*
+ * An entry in the handle table. While the handle is live ptr is the data of
+ * its block, otherwise ptr links the entry into the list of unused entries.
+ * The last word of a handle's block points back at its entry, so my_compact
+ * can tell which allocated blocks it may move.
+ *
+ * FIELDS
+ * void * ptr The data of the block or the next unused entry
+ * size_t pins Number of my_hpin calls not yet matched by my_hunpin
+ */
+struct my_handle_entry {
+  void * ptr;
+  size_t pins;
+};
+
+/*
+ * Table of handles returned by my_halloc along with the head of the list of
+ * unused entries and the number of entries ever used, protected by
+ * handleLock. my_compact holds handleLock while it moves blocks so a block is
+ * never moved while it is being pinned.
+ */
+static struct my_handle_entry handleTable[MAX_HANDLES];
+static struct my_handle_entry * freeHandles;
+static size_t numHandles = 0;
+static malloc_lock handleLock;
+
+/*
+ * Counters of each allocation tag, updated atomically without a lock since
+ * they are only ever read as a snapshot. Untagged allocations never touch
+ * them.
+ *
+ * FIELDS
+ * const char * name The name given with my_malloc_tag_name
+ * size_t live_bytes Usable bytes of allocations not yet freed
+ * size_t live_allocations Allocations not yet freed
+ * size_t total_allocations Allocations ever made
+ */
+typedef struct tag_counters {
+  const char * name;
+  size_t live_bytes;
+  size_t live_allocations;
+  size_t total_allocations;
+} tag_counters;
+
+static tag_counters tagCounters[MAX_TAGS];
+
+/*
+ * Counts of the blocks in one chunk taken by my_malloc_info. Blocks waiting
+ * on a quick list or the pending list look allocated and are counted so.
+ *
+ * FIELDS
+ * size_t offset Offset of the chunk's first fencepost from base
+ * size_t size Size of the chunk including its fenceposts
+ * size_t allocated_blocks Number of allocated blocks
+ * size_t allocated_bytes Total size of the allocated blocks
+ * size_t free_blocks Number of free blocks
+ * size_t free_bytes Total size of the free blocks
+ * size_t largest_free Size of the largest free block
+ */
+typedef struct chunk_info {
+  size_t offset;
+  size_t size;
+  size_t allocated_blocks;
+  size_t allocated_bytes;
+  size_t free_blocks;
+  size_t free_bytes;
+  size_t largest_free;
+} chunk_info;
+
+#if THREAD_LINES
+/*
+ * A cache line aligned span of objects of one size owned by the thread that
+ * allocated it. The span is a single allocated block of the heap. Its objects
+ * have a header of their own with the state SPAN_OBJECT and the offset of the
+ * span in left_size. A span the thread no longer allocates from is returned
+ * to the heap when its last object is freed.
+ *
+ * FIELDS
+ * malloc_lock lock Protects the fields below, other threads take it to free
+ * struct line_span * self Points at the span, checked before a free trusts it
+ * header * free Freed objects linked through next
+ * char * bump The next never used object
+ * char * end The end of the span
+ * size_t used Number of objects allocated and not freed
+ * bool current Whether the owner still allocates from the span
+ */
+typedef struct line_span {
+  malloc_lock lock;
+  struct line_span * self;
+  header * free;
+  char * bump;
+  char * end;
+  size_t used;
+  bool current;
+} line_span;
+
+/* Number of object sizes carved from spans, 16 bytes apart */
+#define LINE_CLASSES (THREAD_LINES_MAX / 16)
+
+/* Offset of the first object in a span, the span header has lines of its own */
+#define LINE_SPAN_HEADER \
+  ((sizeof(line_span) + CACHE_LINE_SIZE - 1) & ~(size_t) (CACHE_LINE_SIZE - 1))
+
+/*
+ * The span the calling thread allocates each object size from
+ */
+static __thread line_span * threadSpans[LINE_CLASSES + 1];
+static __thread bool threadSpansRegistered;
+
+/*
+ * Key used only for its destructor so that a thread's spans are returned to
+ * the heap once their objects are freed after the thread exits
+ */
+static pthread_key_t threadSpanKey;
+static pthread_once_t threadSpanKeyOnce = PTHREAD_ONCE_INIT;
+
+/*
+ * Links the spans of a thread into the list my_malloc_info reports
+ *
+ * FIELDS
+ * line_span ** spans The threadSpans of the thread
+ * struct thread_cache * next The next thread in the list
+ * struct thread_cache * prev The previous thread in the list
+ */
+typedef struct thread_cache {
+  line_span ** spans;
+  struct thread_cache * next;
+  struct thread_cache * prev;
+} thread_cache;
+
+static __thread thread_cache threadCache;
+
+/*
+ * Every thread that allocated from a span and has not exited. The lock also
+ * covers each listed thread's threadSpans, which is only read by other
+ * threads, so a span is unlisted before it is retired.
+ */
+static thread_cache * threadCaches;
+static malloc_lock threadCacheLock;
+#endif
+
+#if ARENA_MMAP
+/*
+ * The unused part of the region most recently reserved with mmap. Chunks are
+ * carved from it in order so consecutive chunks are adjacent and coalesce
+ * just like chunks from sbrk.
+ */
+static char * regionNext;
+static char * regionEnd;
+#endif
+
 /*
  * direct the compiler to run the init function before running main
- * this allows initialization of required globals
+ * this allows initialization of required globals. The priority runs it before
+ * C++ static constructors, which may already call operator new.
  */
-static void init (void) __attribute__ ((constructor));
+static void init (void) __attribute__ ((constructor (101)));
 
 // Helper functions for manipulating pointers to headers
 static inline header * get_header_from_offset(void * ptr, ptrdiff_t off);
 static inline header * get_left_header(header * h);
 static inline header * ptr_to_header(void * p);
+static heap_run * new_heap_run(char * start, size_t size);
+static inline heap_run * find_heap_run(header * h);
+static inline bool is_heap_block(header * h, heap_run * run);
 
 // Helper functions for allocating more memory from the OS
 static inline void initialize_fencepost(header * fp, size_t left_size);
 static inline void insert_os_chunk(header * hdr);
+#if ARENA_MMAP
+static char * reserve_region(size_t size);
+#endif
+static void * request_os_memory(size_t size);
+
+#if GUARD_SAMPLE_RATE > 0
+// Helper functions for sampled allocations surrounded by guard pages
+static inline bool guard_should_sample(size_t size);
+static bool guard_init();
+static void * guard_alloc(size_t size);
+static inline guard_slot * guard_find_slot(void * p);
+static void guard_free(guard_slot * slot, void * p);
+static void guard_report(const char * what, guard_slot * slot, char * addr);
+static void guard_segv_handler(int sig, siginfo_t * info, void * ucontext);
+#endif
+
+#if THREAD_LINES
+// Helper functions for carving small objects from a thread's spans
+static void * line_alloc(size_t size);
+static inline line_span * line_span_of(header * h);
+static void line_free(header * h, line_span * span);
+static void retire_span(line_span * span);
+static void release_thread_spans(void * unused);
+static void create_thread_span_key(void);
+#endif
+
+// Helper functions for setting up the allocator
+static void init_locks();
+static header * init_arena();
+#if MALLOC_FORK_RESET
+static void fork_prepare();
+static void fork_parent();
+static void fork_child();
+#endif
 static inline void insert_fenceposts(void * raw_mem, size_t size);
 static header * allocate_chunk(size_t size);
+static bool add_chunk(size_t actual_size);
+static void soft_limit_exceeded(my_malloc_limit_callback callback,
+                                size_t heap_bytes, size_t soft_limit);
+
+// Helper functions for locking and manipulating the freelists
+static inline int list_index(size_t size);
+static inline size_t class_size(int index);
+static inline int alloc_index(size_t actual_size);
+static inline malloc_lock * list_lock(int index);
+static void lock_lists(lock_set * set, int * indices, int n);
+static void unlock_lists(lock_set * set);
+static void lock_neighbor_lists(lock_set * set, header * ptr, header * left,
+                                header * right);
+static void locked_insert(header * h);
 
 // Helper functions for freeing a block
+static void zero_block(void * p, size_t n);
+static inline void coalesce_object(header * ptr);
 static inline void deallocate_object(void * p);
 
+#if N_QUICK_LISTS > 0
+// Helper functions for deferring coalescing of small blocks
+static inline header * quick_list_pop(int row);
+static inline bool quick_list_push(header * ptr);
+static bool consolidate_quick_lists();
+#endif
+
 // Helper functions for allocating a block
+static inline void fit_rover_moved(header * from, header * to);
+static inline header * find_fit(size_t actual_size);
+static inline header * allocate_exact_fit(int row);
+static inline header * allocate_from_freelists(size_t actual_size, int row);
 static inline header * allocate_object(size_t raw_size);
 
+// Helper functions for accounting tagged blocks
+static inline size_t tagged_usable_size(header * h);
+static inline unsigned block_tag(header * h);
+static unsigned allocation_tag(void * p);
+static void untag_block(header * h);
+
+// Helper functions for writing my_malloc_info
+static void chunk_snapshot(header * fencepost, chunk_info * info);
+static void json_string(FILE * out, const char * s);
+
+// Helper functions for moving handle blocks
+static inline my_handle block_handle(header * h);
+static header * slide_block(header * free_block, header * block, my_handle handle);
+static size_t compact_run(header * first);
+
 // Helper functions for verifying that the data structures are structurally 
 // valid
 static inline header * detect_cycles();
@@ -82,6 +551,22 @@ static inline header * verify_pointers();
 static inline bool verify_freelist();
 static inline header * verify_chunk(header * chunk);
 static inline bool verify_tags();
+static inline void verify_cursor_moved(header * from, header * to);
+static inline bool verify_link(header * h, int index);
+static bool verify_block(header * h);
+#if VERIFY_EVERY_N_FREES > 0 || VERIFY_INTERVAL_MS > 0
+static void verify_or_abort();
+#endif
+#if VERIFY_INTERVAL_MS > 0
+static void * verify_thread(void * arg);
+#endif
+
+// Helper functions for deferring coalescing to a background thread
+#if BACKGROUND_INTERVAL_MS > 0
+static inline void pending_push(header * ptr);
+static size_t drain_pending_frees();
+static void * background_thread(void * arg);
+#endif
 
 static void init();
 
@@ -167,6 +652,93 @@ inline static void insert_fenceposts(void * raw_mem, size_t size) {
   initialize_fencepost(rightFencePost, size - 2 * ALLOC_HEADER_SIZE);
 }
 
+#if ARENA_MMAP
+/**
+ * @brief Reserve a huge page aligned region with mmap, asking the kernel to
+ *        back it with transparent huge pages when ARENA_HUGEPAGES is set
+ *
+ * @param size The size of the region, a multiple of HUGE_PAGE_SIZE
+ *
+ * @return The start of the region or NULL if the OS is out of memory
+ */
+static char * reserve_region(size_t size) {
+  // Over reserve by a huge page and unmap the unaligned ends
+  size_t padded = size + HUGE_PAGE_SIZE;
+  if (padded < size) {
+    return NULL;
+  }
+  char * mem = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
+
+  char * region = (char *) (((uintptr_t) mem + HUGE_PAGE_SIZE - 1) &
+                            ~(uintptr_t) (HUGE_PAGE_SIZE - 1));
+  if (region > mem) {
+    munmap(mem, region - mem);
+  }
+  if (mem + padded > region + size) {
+    munmap(region + size, mem + padded - (region + size));
+  }
+
+#if ARENA_HUGEPAGES
+  madvise(region, size, MADV_HUGEPAGE);
+#else
+  madvise(region, size, MADV_NOHUGEPAGE);
+#endif
+  return region;
+}
+#endif
+
+/**
+ * @brief Request memory for a chunk from the OS, with sbrk or from the
+ *        current mmap region depending on ARENA_MMAP
+ *
+ * @param size The number of bytes needed
+ *
+ * @return The memory or NULL if the OS is out of memory
+ */
+static void * request_os_memory(size_t size) {
+  if (size > INTPTR_MAX) {
+    return NULL;
+  }
+
+#if ARENA_MMAP
+  if ((size_t) (regionEnd - regionNext) < size) {
+    // The rest of the current region is abandoned, it was never touched so
+    // it costs only address space
+    size_t reserve = ARENA_RESERVE_SIZE;
+    if (size > reserve) {
+      reserve = (size + HUGE_PAGE_SIZE - 1) & ~(size_t) (HUGE_PAGE_SIZE - 1);
+    }
+    char * region = reserve_region(reserve);
+    if (!region) {
+      return NULL;
+    }
+    regionNext = region;
+    regionEnd = region + reserve;
+  }
+
+  void * mem = regionNext;
+  regionNext += size;
+  return mem;
+#else
+#if MALLOC_ALIGNMENT > MIN_ALLOCATION
+  // Other users of sbrk may leave the break unaligned
+  uintptr_t brk = (uintptr_t) sbrk(0);
+  if (brk & (MALLOC_ALIGNMENT - 1)) {
+    sbrk(MALLOC_ALIGNMENT - (brk & (MALLOC_ALIGNMENT - 1)));
+  }
+#endif
+  void * mem = sbrk(size);
+  if (mem == (void *) -1) {
+    return NULL;
+  }
+  return mem;
+#endif
+}
+
 /**
  * @brief Allocate another chunk from the OS and prepare to insert it
  * into the free list
@@ -174,10 +746,13 @@ inline static void insert_fenceposts(void * raw_mem, size_t size) {
  * @param size The size to allocate from the OS
  *
  * @return A pointer to the allocable block in the chunk (just after the 
- * first fencpost)
+ * first fencpost) or NULL if the OS is out of memory
  */
 static header * allocate_chunk(size_t size) {
-  void * mem = sbrk(size);
+  void * mem = request_os_memory(size);
+  if (!mem) {
+    return NULL;
+  }
   
   insert_fenceposts(mem, size);
   header * hdr = (header *) ((char *)mem + ALLOC_HEADER_SIZE);
@@ -188,161 +763,622 @@ static header * allocate_chunk(size_t size) {
 }
 
 /**
+ * @brief Helper to compute the freelist a free block of a given size belongs in
  *
+ * @param size The size of the block including metadata
+ *
+ * @return The index of the freelist
  */
-void insert(header *h) {
-  int index = (get_size(h) - ALLOC_HEADER_SIZE) / MIN_ALLOCATION - 1;
+static inline int list_index(size_t size) {
+  size_t index;
+#if SIZE_CLASSES == SIZE_CLASSES_GEOMETRIC
+  if (size >= (size_t) 1 << GEOMETRIC_MIN_SHIFT) {
+    // The class is the power of two below size and the next two bits
+    int shift = (int) (8 * sizeof(size_t) - 1) - __builtin_clzl(size);
+    index = LINEAR_LISTS + (size_t) (shift - GEOMETRIC_MIN_SHIFT) * 4 +
+            ((size >> (shift - 2)) & 3);
+    if (index > N_LISTS - 1) index = N_LISTS - 1;
+    return (int) index;
+  }
+#endif
+  // Clamp before narrowing so sizes beyond 2GB land in the last list
+  index = (size - ALLOC_HEADER_SIZE) / MIN_ALLOCATION - 1;
   if (index == 0) index = 1;
   if (index > N_LISTS - 1) index = N_LISTS - 1;
-  header *dummy = &freelistSentinels[index];
-  if (dummy->next == dummy) {
-    dummy->next = h;
-    dummy->prev = h;
-    h->next = dummy;
-    h->prev = dummy;
-  } else {
-    dummy->next->prev = h;
-    h->next = dummy->next;
-    h->prev = dummy;
-    dummy->next = h;
+  return (int) index;
+}
+
+/**
+ * @brief Helper to compute the smallest block size kept in a freelist
+ *
+ * @param index The index of the freelist
+ *
+ * @return The size of the smallest block in the list including metadata
+ */
+static inline size_t class_size(int index) {
+#if SIZE_CLASSES == SIZE_CLASSES_GEOMETRIC
+  if (index >= LINEAR_LISTS) {
+    int step = index - LINEAR_LISTS;
+    int shift = GEOMETRIC_MIN_SHIFT + step / 4;
+    return (size_t) (4 + step % 4) << (shift - 2);
   }
+#endif
+  return (size_t) (index + 1) * MIN_ALLOCATION + ALLOC_HEADER_SIZE;
 }
 
-/*
+/**
+ * @brief Helper to compute the first freelist where every block can hold an
+ *        allocation, the last list is searched if no other list can
+ *
+ * @param actual_size The size of the block needed including metadata
  *
+ * @return The index of the freelist
  */
-header *no_split_alloc(header *ptr) {
-  ptr->prev->next = ptr->next;
-  ptr->next->prev = ptr->prev;
-  ptr->prev = NULL;
-  ptr->next = NULL;
-  set_state(ptr, ALLOCATED);
-  return (header *)(ptr->data);
+static inline int alloc_index(size_t actual_size) {
+  int index = list_index(actual_size);
+  if (index < N_LISTS - 1 && class_size(index) < actual_size) {
+    index++;
+  }
+  return index;
 }
 
-/*
+/**
+ * @brief Helper to get the lock protecting a freelist
  *
+ * @param index The index of the freelist
+ *
+ * @return The lock shared by the group of lists containing index
  */
-header *split_alloc(header *ptr, header *ptr2, int actual_size) {
-  header *right = get_right_header(ptr);
-  ptr2 = get_header_from_offset(ptr2, ptr->size_state - actual_size);
-  set_size(ptr, ptr->size_state - actual_size);
-  set_size(ptr2, actual_size);
-  ptr2->left_size = ptr->size_state;
-  right->left_size = ptr2->size_state;
-  ptr2->prev = NULL;
-  ptr2->next = NULL;
-  set_state(ptr2, ALLOCATED);
+static inline malloc_lock * list_lock(int index) {
+  return &listLocks[index / LISTS_PER_LOCK].lock;
+}
 
-  int new_size = get_size(ptr) - ALLOC_HEADER_SIZE;
-  if (new_size / 8 < N_LISTS) {
-    ptr->prev->next = ptr->next;
-    ptr->next->prev = ptr->prev;
-    ptr->prev = NULL;
-    ptr->next = NULL;
-    insert(ptr);
+/**
+ * @brief Acquire the locks of a set of freelists in ascending order so that
+ *        threads holding several list locks can never deadlock
+ *
+ * @param set The set to record the acquired locks in
+ * @param indices The indices of the freelists, reordered by this function
+ * @param n The number of indices
+ */
+static void lock_lists(lock_set * set, int * indices, int n) {
+  for (int i = 1; i < n; i++) {
+    for (int j = i; j > 0 && indices[j - 1] > indices[j]; j--) {
+      int tmp = indices[j];
+      indices[j] = indices[j - 1];
+      indices[j - 1] = tmp;
+    }
   }
 
-  return (header *)(ptr2->data);
+  set->n = 0;
+  for (int i = 0; i < n; i++) {
+    malloc_lock * l = list_lock(indices[i]);
+    // Lists in the same group share a lock which must only be taken once
+    if (set->n == 0 || set->locks[set->n - 1] != l) {
+      malloc_lock_acquire(l);
+      set->locks[set->n++] = l;
+    }
+  }
 }
 
-/*
+/**
+ * @brief Release the locks acquired by lock_lists
  *
+ * @param set The set of acquired locks
  */
-void isolate(header *h) {
-  h->prev->next = h->next;
-  h->next->prev = h->prev;
-  h->next = NULL;
-  h->prev = NULL;
+static void unlock_lists(lock_set * set) {
+  while (set->n > 0) {
+    malloc_lock_release(set->locks[--set->n]);
+  }
 }
 
 /**
- * @brief Helper allocate an object given a raw request size from the user
+ * @brief Lock the freelists a free would modify: the lists of the free
+ *        neighbors and the list the coalesced block is inserted into
  *
- * @param raw_size number of bytes the user needs
+ * The tag lock must be held so the sizes of free blocks are stable. Free
+ * neighbors can still be allocated by exact fit allocations until their list
+ * is locked, in which case the locks are dropped and taken again.
  *
- * @return A block satisfying the user's request
+ * @param set The set to record the acquired locks in
+ * @param ptr The block being freed
+ * @param left The left neighbor of ptr
+ * @param right The right neighbor of ptr
  */
-static inline header *allocate_object(size_t raw_size) {
-  // TODO implement allocation
-  if (raw_size == 0) return NULL;
+static void lock_neighbor_lists(lock_set * set, header * ptr, header * left,
+                                header * right) {
+  for (;;) {
+    bool left_free = get_state(left) == UNALLOCATED;
+    bool right_free = get_state(right) == UNALLOCATED;
+    size_t size = get_size(ptr);
+    int indices[3];
+    int n = 0;
+    if (left_free) {
+      indices[n++] = list_index(get_size(left));
+      size += get_size(left);
+    }
+    if (right_free) {
+      indices[n++] = list_index(get_size(right));
+      size += get_size(right);
+    }
+    indices[n++] = list_index(size);
 
-  // Calculate the rounded alloc size
-  int alloc_size = ((int)raw_size + 7) & (-MIN_ALLOCATION); // 7 is the largest remainder of MIN_ALLOCATION
-  int actual_size = 0;
-  if (alloc_size <= 2 * sizeof(header *)) {
-    actual_size = sizeof(header);
-  } else {
-    actual_size = ALLOC_HEADER_SIZE + alloc_size;
+    lock_lists(set, indices, n);
+    if ((get_state(left) == UNALLOCATED) == left_free &&
+        (get_state(right) == UNALLOCATED) == right_free) {
+      return;
+    }
+    unlock_lists(set);
   }
+}
 
-  // Use alloc size to calculate row number and check if row contains free block
-  int row = (actual_size - ALLOC_HEADER_SIZE) / MIN_ALLOCATION - 1;
-  if (row > N_LISTS - 1) row = N_LISTS - 1;
+/**
+ * @brief Insert a free block at the head of its freelist, the list's lock
+ *        must be held
+ *
+ * @param h The block to insert
+ */
+void insert(header *h) {
+  header *dummy = &freelistSentinels[list_index(get_size(h))];
+  if (dummy->next == dummy) {
+    dummy->next = h;
+    dummy->prev = h;
+    h->next = dummy;
+    h->prev = dummy;
+  } else {
+    dummy->next->prev = h;
+    h->next = dummy->next;
+    h->prev = dummy;
+    dummy->next = h;
+  }
+}
+
+/**
+ * @brief Insert a free block at the head of its freelist taking the list's lock
+ *
+ * @param h The block to insert
+ */
+static void locked_insert(header *h) {
+  malloc_lock * l = list_lock(list_index(get_size(h)));
+  malloc_lock_acquire(l);
+  insert(h);
+  malloc_lock_release(l);
+}
+
+#if BACKGROUND_INTERVAL_MS > 0
+/**
+ * @brief Helper to find when a free block was last coalesced with a newly
+ *        freed block, kept in the word after its freelist links
+ *
+ * @param h The header of the block
+ *
+ * @return The block's free time or NULL if the block is too small to have one
+ */
+static inline size_t * block_free_time(header * h) {
+  if (get_size(h) < sizeof(header) + sizeof(size_t)) {
+    return NULL;
+  }
+  return (size_t *) ((char *) h + sizeof(header));
+}
+
+/**
+ * @brief Helper to record that a free block now holds freshly freed data
+ *
+ * @param h The header of the block
+ */
+static inline void stamp_free_block(header * h) {
+  size_t * freed = block_free_time(h);
+  if (freed) {
+    *freed = __atomic_load_n(&purgeClock, __ATOMIC_RELAXED);
+  }
+}
+#endif
+
+/*
+ *
+ */
+header *no_split_alloc(header *ptr) {
+  fit_rover_moved(ptr, ptr->next);
+  ptr->prev->next = ptr->next;
+  ptr->next->prev = ptr->prev;
+  ptr->prev = NULL;
+  ptr->next = NULL;
+#if BACKGROUND_INTERVAL_MS > 0
+  size_t * freed = block_free_time(ptr);
+  if (freed) {
+    *freed = 0;
+  }
+#endif
+  set_state(ptr, ALLOCATED);
+  return (header *)(ptr->data);
+}
+
+/*
+ * Carve an allocated block of actual_size bytes from the right end of ptr.
+ * Moving ptr to the freelist matching its new size is left to the caller.
+ */
+header *split_alloc(header *ptr, size_t actual_size) {
+  header *right = get_right_header(ptr);
+  header *ptr2 = get_header_from_offset(ptr, get_size(ptr) - actual_size);
+  set_size(ptr, get_size(ptr) - actual_size);
+  // The new header lands on whatever the free block held, so every bit of
+  // it is written before it is read
+  set_size_and_state(ptr2, actual_size, ALLOCATED);
+  ptr2->left_size = get_size(ptr);
+  right->left_size = get_size(ptr2);
+  ptr2->prev = NULL;
+  ptr2->next = NULL;
+  return (header *)(ptr2->data);
+}
+
+/*
+ *
+ */
+void isolate(header *h) {
+  fit_rover_moved(h, h->next);
+  h->prev->next = h->next;
+  h->next->prev = h->prev;
+  h->next = NULL;
+  h->prev = NULL;
+}
+
+/**
+ * @brief Helper to keep the next fit rover on a block in the last freelist
+ *        when the block under it leaves the list or is replaced, the lists'
+ *        locks must be held
+ *
+ * @param from The block leaving the list
+ * @param to The block taking its place, its successor or the sentinel
+ */
+static inline void fit_rover_moved(header * from, header * to) {
+#if FIT_POLICY == FIT_NEXT
+  // Blocks of other lists never match, so the rover is read atomically in
+  // case the last list's lock is held by another thread
+  if (__atomic_load_n(&fitRover, __ATOMIC_RELAXED) == from) {
+    __atomic_store_n(&fitRover, to == &freelistSentinels[N_LISTS - 1] ? NULL : to,
+                     __ATOMIC_RELAXED);
+  }
+#else
+  (void) from;
+  (void) to;
+#endif
+}
+
+/**
+ * @brief Choose a block from the last freelist following FIT_POLICY, the
+ *        list's lock must be held
+ *
+ * @param actual_size The size of the block needed including metadata
+ *
+ * @return A block at least actual_size bytes or NULL if none fits
+ */
+static inline header * find_fit(size_t actual_size) {
+  header * freelist = &freelistSentinels[N_LISTS - 1];
+#if FIT_POLICY == FIT_FIRST
+  for (header * ptr = freelist->next; ptr != freelist; ptr = ptr->next) {
+    if (actual_size <= get_size(ptr)) {
+      return ptr;
+    }
+  }
+  return NULL;
+#elif FIT_POLICY == FIT_NEXT
+  // Walk the list once around, starting at the rover and skipping the sentinel
+  header * start = fitRover ? fitRover : freelist->next;
+  if (start == freelist) {
+    return NULL;
+  }
+  header * ptr = start;
+  do {
+    if (ptr != freelist && actual_size <= get_size(ptr)) {
+      fitRover = ptr;
+      return ptr;
+    }
+    ptr = ptr->next;
+  } while (ptr != start);
+  return NULL;
+#else
+#if FIT_POLICY == FIT_BEST
+  size_t depth = SIZE_MAX;
+#else
+  size_t depth = FIT_SEARCH_DEPTH;
+#endif
+  header * best = NULL;
+  size_t found = 0;
+  for (header * ptr = freelist->next; ptr != freelist && found < depth;
+       ptr = ptr->next) {
+    if (actual_size > get_size(ptr)) {
+      continue;
+    }
+    found++;
+    if (!best || get_size(ptr) < get_size(best)) {
+      best = ptr;
+      // A block too small to split cannot be beaten
+      if (get_size(ptr) - actual_size < sizeof(header)) {
+        break;
+      }
+    }
+  }
+  return best;
+#endif
+}
+
+/**
+ * @brief Allocate from the exact size class, blocks there never need to be
+ *        split so only the list's lock is taken
+ *
+ * @param row The index of the freelist
+ *
+ * @return A block from the list or NULL if the list is empty
+ */
+static inline header * allocate_exact_fit(int row) {
+  malloc_lock * l = list_lock(row);
+  header * freelist = &freelistSentinels[row];
+  header * hdr = NULL;
+
+  malloc_lock_acquire(l);
+#if N_QUICK_LISTS > 0
+  hdr = quick_list_pop(row);
+  if (hdr) {
+    malloc_lock_release(l);
+    return hdr;
+  }
+#endif
+  if (freelist->next != freelist) {
+    hdr = no_split_alloc(freelist->next);
+  }
+  malloc_lock_release(l);
+  return hdr;
+}
+
+/**
+ * @brief Search the freelists for a block and split it if needed, the tag
+ *        lock must be held
+ *
+ * @param actual_size The size of the block needed including metadata
+ * @param row The index of the freelist to start searching at
+ *
+ * @return A block satisfying the request or NULL if none is free
+ */
+static inline header * allocate_from_freelists(size_t actual_size, int row) {
   header *ptr = NULL;
-  header *ptr2 = NULL;
-  int split;
+  header *hdr = NULL;
+  size_t split;
   for (int i = row; i < N_LISTS; i++) {
+    // Lists only gain blocks while the tag lock is held so a list that is
+    // empty now stays empty and can be skipped without taking its lock
+    if (freelistSentinels[i].next == &freelistSentinels[i]) {
+      continue;
+    }
+    malloc_lock * l = list_lock(i);
+    malloc_lock_acquire(l);
     // Case: enters last row
     if (i == N_LISTS - 1) {
-      ptr = &freelistSentinels[i];
-      while (ptr->next != &freelistSentinels[i]) {
-        ptr = ptr->next;
-        if (actual_size <= ptr->size_state) {
-          split = ptr->size_state - actual_size;
-          if (split < sizeof(header)) {
-            // Case: no split
-            return no_split_alloc(ptr);
-          } else {
-            //Case: split
-            ptr2 = ptr;
-            return split_alloc(ptr, ptr2, actual_size);
+      ptr = find_fit(actual_size);
+      if (ptr) {
+        split = ptr->size_state - actual_size;
+        if (split < sizeof(header)) {
+          // Case: no split
+          hdr = no_split_alloc(ptr);
+        } else {
+          //Case: split, the remainder stays in place if it is still large
+          hdr = split_alloc(ptr, actual_size);
+          if (list_index(get_size(ptr)) < N_LISTS - 1) {
+            isolate(ptr);
+            malloc_lock_release(l);
+            locked_insert(ptr);
+            return hdr;
           }
         }
       }
-      break;
+      malloc_lock_release(l);
+      return hdr;
     }
     // Case: finds free block before last row
     if (freelistSentinels[i].next != &freelistSentinels[i]) {
       ptr = freelistSentinels[i].next;
       split = ptr->size_state - actual_size;
       if (split < sizeof(header)) {
-        return no_split_alloc(ptr);
-      } else {
-        ptr2 = ptr;
-        return split_alloc(ptr, ptr2, actual_size);
+        hdr = no_split_alloc(ptr);
+        malloc_lock_release(l);
+        return hdr;
       }
+      isolate(ptr);
+      malloc_lock_release(l);
+      hdr = split_alloc(ptr, actual_size);
+      locked_insert(ptr);
+      return hdr;
     }
+    malloc_lock_release(l);
   }
-  
-  // Task 3: ptr did not find appropriate block in entire freelist
-  header *first_header = allocate_chunk(ARENA_SIZE);
+  return NULL;
+}
+
+/**
+ * @brief Request another chunk from the OS and add it to the freelists,
+ *        coalescing it with the previous chunk when they are adjacent
+ *
+ * @param actual_size The size of the block that must fit in the chunk
+ *
+ * @return false if the OS is out of memory
+ */
+static bool add_chunk(size_t actual_size) {
+  // Chunks are a multiple of ARENA_SIZE large enough for the request so a
+  // large allocation is served by a single call to sbrk
+  size_t chunk_size = ARENA_SIZE;
+  if (actual_size > ARENA_SIZE - 2 * ALLOC_HEADER_SIZE) {
+    size_t needed = actual_size + 2 * ALLOC_HEADER_SIZE;
+    if (needed < actual_size || needed > SIZE_MAX - ARENA_SIZE) {
+      return false;
+    }
+    chunk_size = (needed + ARENA_SIZE - 1) / ARENA_SIZE * ARENA_SIZE;
+  }
+
+  malloc_lock_acquire(&chunkLock);
+  size_t grown;
+  if (__builtin_add_overflow(heapSize, chunk_size, &grown) ||
+      (hardLimit && grown > hardLimit)) {
+    malloc_lock_release(&chunkLock);
+    return false;
+  }
+  header *first_header = allocate_chunk(chunk_size);
+  if (!first_header) {
+    malloc_lock_release(&chunkLock);
+    return false;
+  }
+
+  // Pages of a chunk merged with the previous one map to the same run
+  char *chunk = (char *)first_header - ALLOC_HEADER_SIZE;
+  heap_run *run = NULL;
+  if ((header *)((char *)lastFencePost + 2 * ALLOC_HEADER_SIZE) == first_header) {
+    run = page_map_get(&pageMap, lastFencePost);
+  } else {
+    run = new_heap_run(chunk, chunk_size);
+  }
+  if (!run || !page_map_set(&pageMap, chunk, chunk_size, run)) {
+    malloc_lock_release(&chunkLock);
+    return false;
+  }
+  __atomic_store_n(&run->end, chunk + chunk_size, __ATOMIC_RELEASE);
+
+  malloc_lock_acquire(&tagLock);
   if ((header *)((char *)lastFencePost + 2 * ALLOC_HEADER_SIZE) == first_header) {
     first_header = lastFencePost;
-    set_size_and_state(first_header, ARENA_SIZE, UNALLOCATED);
-    memset((void *)((char *)first_header + ALLOC_HEADER_SIZE), 0, ARENA_SIZE - ALLOC_HEADER_SIZE);
+    set_size_and_state(first_header, chunk_size, UNALLOCATED);
+    // Memory fresh from sbrk is already zero apart from the left fencepost
+    // and block header written by allocate_chunk
+    memset((void *)((char *)first_header + ALLOC_HEADER_SIZE), 0, 2 * ALLOC_HEADER_SIZE);
     header *last_header = get_left_header(first_header);
+    malloc_lock *l = NULL;
     if (get_state(last_header) == UNALLOCATED) {
-      int last_header_size = get_size(last_header) - ALLOC_HEADER_SIZE;
+      l = list_lock(list_index(get_size(last_header)));
+      malloc_lock_acquire(l);
+    }
+    // The last block may have been allocated before its list was locked
+    if (l && get_state(last_header) == UNALLOCATED) {
+      int last_index = list_index(get_size(last_header));
       set_size(last_header, get_size(last_header) + get_size(first_header));
       memset((void *)first_header, 0, ALLOC_HEADER_SIZE);
       get_right_header(last_header)->left_size = get_size(last_header);
-      if (last_header_size / 8 < N_LISTS) {
+      verify_cursor_moved(first_header, last_header);
+      if (last_index < N_LISTS - 1) {
         isolate(last_header);
-        insert(last_header);
+        malloc_lock_release(l);
+        l = NULL;
+        locked_insert(last_header);
       }
       lastFencePost = get_right_header(last_header);
     } else {
-      insert(first_header);
+      if (l) {
+        malloc_lock_release(l);
+        l = NULL;
+      }
+      get_right_header(first_header)->left_size = get_size(first_header);
+      locked_insert(first_header);
       lastFencePost = get_right_header(first_header);
     }
+    if (l) {
+      malloc_lock_release(l);
+    }
     last_header = NULL;
   } else {
-    insert(first_header);
+    locked_insert(first_header);
     lastFencePost = get_right_header(first_header);
     insert_os_chunk(get_left_header(first_header));
   }
-  first_header = NULL;
+  malloc_lock_release(&tagLock);
+
+  heapSize = grown;
+  size_t soft = softLimit;
+  my_malloc_limit_callback callback = limitCallback;
+  malloc_lock_release(&chunkLock);
+
+  if (soft && grown > soft) {
+    soft_limit_exceeded(callback, grown, soft);
+  }
+  return true;
+}
+
+/**
+ * @brief Let the program shed memory after the heap grew past the soft
+ *        limit, then return the pages it freed to the OS. No lock is held.
+ *
+ * @param callback The callback set with the limit or NULL
+ * @param heap_bytes The size the heap grew to
+ * @param soft_limit The soft limit
+ */
+static void soft_limit_exceeded(my_malloc_limit_callback callback,
+                                size_t heap_bytes, size_t soft_limit) {
+  if (inLimitCallback) {
+    return;
+  }
+  inLimitCallback = true;
+  if (callback) {
+    callback(heap_bytes, soft_limit);
+  }
+  my_malloc_trim();
+  inLimitCallback = false;
+}
+
+/**
+ * @brief Helper allocate an object given a raw request size from the user
+ *
+ * @param raw_size number of bytes the user needs
+ *
+ * @return A block satisfying the user's request
+ */
+static inline header *allocate_object(size_t raw_size) {
+  // TODO implement allocation
+  if (raw_size == 0) return NULL;
+
+  // Requests so large that rounding them or adding the header and the
+  // fenceposts of their chunk would wrap around can never be satisfied
+  if (raw_size > SIZE_MAX - ARENA_SIZE - 3 * ALLOC_HEADER_SIZE) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  // Calculate the rounded alloc size
+  size_t alloc_size = (raw_size + MALLOC_ALIGNMENT - 1) & ~(size_t) (MALLOC_ALIGNMENT - 1);
+  size_t actual_size = 0;
+  if (alloc_size <= 2 * sizeof(header *)) {
+    actual_size = sizeof(header);
+  } else {
+    actual_size = ALLOC_HEADER_SIZE + alloc_size;
+  }
+
+  // Use alloc size to calculate row number and check if row contains free block
+  int row = alloc_index(actual_size);
+
+  // Blocks in the exact size class are allocated without the tag lock so
+  // allocations of unrelated sizes proceed in parallel
+  header *hdr = NULL;
+  if (row < EXACT_LISTS) {
+    hdr = allocate_exact_fit(row);
+    if (hdr) return hdr;
+  }
+
+  malloc_lock_acquire(&tagLock);
+  hdr = allocate_from_freelists(actual_size, row);
+#if N_QUICK_LISTS > 0
+  // Coalescing the blocks held in the quick lists may free a large enough block
+  if (!hdr && consolidate_quick_lists()) {
+    hdr = allocate_from_freelists(actual_size, row);
+  }
+#endif
+#if BACKGROUND_INTERVAL_MS > 0
+  // As may coalescing the blocks the background thread has not reached yet
+  if (!hdr && drain_pending_frees()) {
+    hdr = allocate_from_freelists(actual_size, row);
+  }
+#endif
+  malloc_lock_release(&tagLock);
+  if (hdr) return hdr;
+  
+  // Task 3: ptr did not find appropriate block in entire freelist
+  if (!add_chunk(actual_size)) {
+    errno = ENOMEM;
+    return NULL;
+  }
   return allocate_object(raw_size);
 }
 
@@ -357,6 +1393,86 @@ static inline header * ptr_to_header(void * p) {
   return (header *)((char *) p - ALLOC_HEADER_SIZE); //sizeof(header));
 }
 
+/**
+ * @brief Helper to create the descriptor of a new run of chunks, the chunk
+ *        lock must be held
+ *
+ * @param start The first byte of the run
+ * @param size The size of the run
+ *
+ * @return The descriptor or NULL if the OS is out of memory
+ */
+static heap_run * new_heap_run(char * start, size_t size) {
+  if (numSpareRuns == 0) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    void * mem = mmap(NULL, page, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      return NULL;
+    }
+    spareRuns = (heap_run *) mem;
+    numSpareRuns = page / sizeof(heap_run);
+  }
+
+  heap_run * run = spareRuns++;
+  numSpareRuns--;
+  run->start = start;
+  run->end = start + size;
+#if MALLOC_FORK_RESET
+  run->generation = heapGeneration;
+#endif
+  return run;
+}
+
+/**
+ * @brief Helper to find the run of chunks a header lies in without reading
+ *        the header
+ *
+ * @param h The header to look up
+ *
+ * @return The run or NULL if h is not between the fenceposts of a run
+ */
+static inline heap_run * find_heap_run(header * h) {
+  heap_run * run = page_map_get(&pageMap, h);
+  if (!run || (uintptr_t) h & (MIN_ALLOCATION - 1)) {
+    return NULL;
+  }
+  char * end = __atomic_load_n(&run->end, __ATOMIC_ACQUIRE);
+  if ((char *) h < run->start + ALLOC_HEADER_SIZE ||
+      (char *) h + sizeof(header) + ALLOC_HEADER_SIZE > end) {
+    return NULL;
+  }
+  return run;
+}
+
+/**
+ * @brief Helper to check a header is the start of a block by comparing its
+ *        boundary tags with its neighbors'. Without the tag lock the
+ *        neighbors may be split or coalesced while they are read, so only
+ *        a true result can be trusted and a false one must be rechecked
+ *        with the lock held.
+ *
+ * @param h The header to check
+ * @param run The run containing h
+ *
+ * @return true if both neighbors lie in the run and agree with h's tags
+ */
+static inline bool is_heap_block(header * h, heap_run * run) {
+  size_t size = get_size(h);
+  char * end = __atomic_load_n(&run->end, __ATOMIC_ACQUIRE);
+  if (size < sizeof(header) || size > (size_t) (end - (char *) h - ALLOC_HEADER_SIZE)) {
+    return false;
+  }
+  if (get_right_header(h)->left_size != size) {
+    return false;
+  }
+  if (h->left_size < ALLOC_HEADER_SIZE ||
+      h->left_size > (size_t) ((char *) h - run->start)) {
+    return false;
+  }
+  return get_size(get_left_header(h)) == h->left_size;
+}
+
 /**
  * @brief Helper to manage deallocation of a pointer returned by the user
  *
@@ -367,64 +1483,404 @@ static inline void deallocate_object(void * p) {
   // Freeing a null pointer
   if (!p) return;
   header *ptr = ptr_to_header(p);
+  // Pointers outside the heap are rejected before their header is read
+  heap_run *run = find_heap_run(ptr);
+  if (!run) {
+    puts("Invalid Free Detected");
+    return;
+  }
+#if MALLOC_FORK_RESET
+  // Blocks inherited across a fork are leaked rather than copying the page
+  if (run->generation != heapGeneration) {
+    return;
+  }
+#endif
+  // A block coalesced into its left neighbor has a zeroed header, so only a
+  // header with a size can be told apart from a double free
+  bool block = is_heap_block(ptr, run);
+  if (!block) {
+    // Neighbors being split or coalesced by other threads can fail the check
+    // of a valid block, so it is repeated with their headers held still
+    malloc_lock_acquire(&tagLock);
+    block = is_heap_block(ptr, run);
+    malloc_lock_release(&tagLock);
+  }
+  if (!block && get_size(ptr)) {
+    puts("Invalid Free Detected");
+    return;
+  }
   if (get_state(ptr) != ALLOCATED) {
     puts("Double Free Detected");
     assert(false);
   }
-  header *left = get_left_header(ptr);
-  header *right = get_right_header(ptr);
+#if N_QUICK_LISTS > 0
+  if (block && ptr->prev == QUICK_MARK) {
+    puts("Double Free Detected");
+    assert(false);
+  }
+#endif
+  if (!block) {
+    puts("Invalid Free Detected");
+    return;
+  }
+  if (ptr->size_state & TAGGED_BIT) {
+    untag_block(ptr);
+  }
 
-  if ((get_state(left) != UNALLOCATED) && (get_state(right) != UNALLOCATED)) {
-    set_state(ptr, UNALLOCATED);
-    memset(p, 0, get_size(ptr) - ALLOC_HEADER_SIZE);
-    insert(ptr);
+#if N_QUICK_LISTS > 0
+  if (quick_list_push(ptr)) return;
+#endif
+
+#if BACKGROUND_INTERVAL_MS > 0
+  pending_push(ptr);
+#else
+  malloc_lock_acquire(&tagLock);
+  coalesce_object(ptr);
+  malloc_lock_release(&tagLock);
+#endif
+}
+
+/**
+ * @brief Helper to zero freed memory. The page aligned middle of a large
+ *        range is returned to the OS, which zeroes it on the next touch, so
+ *        freeing a huge block does not write to (or fault in) all of it.
+ *
+ * @param p The start of the range
+ * @param n The number of bytes to zero
+ */
+static void zero_block(void * p, size_t n) {
+#if !ZERO_ON_FREE
+  // Headers of absorbed blocks must still be cleared so a stale header is
+  // never mistaken for an allocated block
+  memset(p, 0, n < sizeof(header) ? n : sizeof(header));
+  return;
+#endif
+  if (n < ZERO_MADVISE_THRESHOLD) {
+    memset(p, 0, n);
     return;
   }
 
-  if ((get_state(left) == UNALLOCATED) && (get_state(right) != UNALLOCATED)) {
-    int left_index = (get_size(left) - ALLOC_HEADER_SIZE) / 8 - 1;
-    right->left_size = get_size(left) + get_size(ptr);
-    set_size(left, get_size(left) + get_size(ptr));
-    memset((void *)((char *)p - ALLOC_HEADER_SIZE), 0, get_size(ptr));
-    if (left_index < N_LISTS - 1) {
-      isolate(left);
-      insert(left);
-    }
+  size_t page = sysconf(_SC_PAGESIZE);
+  char * start = (char *) p;
+  char * end = start + n;
+  char * page_start = (char *) (((uintptr_t) start + page - 1) & ~(page - 1));
+  char * page_end = (char *) ((uintptr_t) end & ~(page - 1));
+  if (madvise(page_start, page_end - page_start, MADV_DONTNEED) != 0) {
+    memset(p, 0, n);
     return;
   }
+  memset(start, 0, page_start - start);
+  memset(page_end, 0, end - page_end);
+}
 
-  if ((get_state(left) != UNALLOCATED) && (get_state(right) == UNALLOCATED)) {
-    int right_index = (get_size(right) - ALLOC_HEADER_SIZE) / 8 - 1;
-    memset(p, 0, get_size(ptr) - ALLOC_HEADER_SIZE);
+/**
+ * @brief Helper to mark a block free, coalescing it with its free neighbors
+ *        and inserting it into the freelists. The tag lock must be held.
+ *
+ * @param ptr The header of the block to free
+ */
+static inline void coalesce_object(header * ptr) {
+  void *p = ptr->data;
+  header *left = get_left_header(ptr);
+  header *right = get_right_header(ptr);
+  lock_set locks;
+  lock_neighbor_lists(&locks, ptr, left, right);
+
+  // The block the freed data ends up in
+  header *block = ptr;
+  if ((get_state(left) != UNALLOCATED) && (get_state(right) != UNALLOCATED)) {
+    set_state(ptr, UNALLOCATED);
+    zero_block(p, get_size(ptr) - ALLOC_HEADER_SIZE);
+    insert(ptr);
+  } else if ((get_state(left) == UNALLOCATED) && (get_state(right) != UNALLOCATED)) {
+    int left_index = list_index(get_size(left));
+    right->left_size = get_size(left) + get_size(ptr);
+    set_size(left, get_size(left) + get_size(ptr));
+    zero_block((void *)((char *)p - ALLOC_HEADER_SIZE), get_size(ptr));
+    verify_cursor_moved(ptr, left);
+    if (left_index < N_LISTS - 1) {
+      isolate(left);
+      insert(left);
+    }
+    block = left;
+  } else if ((get_state(left) != UNALLOCATED) && (get_state(right) == UNALLOCATED)) {
+    int right_index = list_index(get_size(right));
+    zero_block(p, get_size(ptr) - ALLOC_HEADER_SIZE);
     right->prev->next = ptr;
     right->next->prev = ptr;
     ptr->next = right->next;
     ptr->prev = right->prev;
+    fit_rover_moved(right, ptr);
     header *right_of_right = get_right_header(right);
     right_of_right->left_size = get_size(ptr) + get_size(right);
     set_state(ptr, UNALLOCATED);
     set_size(ptr, get_size(ptr) + get_size(right));
-    memset((void *)right, 0, get_size(right));
+    zero_block((void *)right, get_size(right));
+    verify_cursor_moved(right, ptr);
     if (right_index < N_LISTS - 1) {
       isolate(ptr);
       insert(ptr);
     }
-    return;
-  }
-
-  if ((get_state(left) == UNALLOCATED) && (get_state(right) == UNALLOCATED)) {
-    int left_index = (get_size(left) - ALLOC_HEADER_SIZE) / 8 - 1;
+  } else {
+    int left_index = list_index(get_size(left));
     header* right_of_right = get_right_header(right);
     right_of_right->left_size = get_size(left) + get_size(ptr) + get_size(right);
     isolate(right);
     set_size(left, get_size(left) + get_size(ptr) + get_size(right));
-    memset((void *)((char *)p - ALLOC_HEADER_SIZE), 0, get_size(ptr) + sizeof(header));
+    zero_block((void *)((char *)p - ALLOC_HEADER_SIZE), get_size(ptr) + sizeof(header));
+    verify_cursor_moved(ptr, left);
+    verify_cursor_moved(right, left);
     if (left_index < N_LISTS - 1) {
       isolate(left);
       insert(left);
     }
-    return;
+    block = left;
+  }
+#if BACKGROUND_INTERVAL_MS > 0
+  stamp_free_block(block);
+#else
+  (void) block;
+#endif
+
+  unlock_lists(&locks);
+}
+
+#if N_QUICK_LISTS > 0
+/**
+ * @brief Pop the most recently freed block from a quick list, the list's
+ *        lock must be held
+ *
+ * @param row The index of the quick list
+ *
+ * @return The data of the block or NULL if the quick list is empty
+ */
+static inline header * quick_list_pop(int row) {
+  if (row > N_QUICK_LISTS || !quickLists[row]) {
+    return NULL;
+  }
+
+  header * ptr = quickLists[row];
+  quickLists[row] = ptr->next;
+  ptr->next = NULL;
+  ptr->prev = NULL;
+  __atomic_fetch_sub(&quickListBytes, get_size(ptr), __ATOMIC_RELAXED);
+  return (header *)(ptr->data);
+}
+
+/**
+ * @brief Push a freed block onto its quick list without coalescing it,
+ *        consolidating all of the quick lists once they exceed
+ *        QUICK_LIST_BUDGET bytes
+ *
+ * @param ptr The header of the block being freed
+ *
+ * @return false if the block is too large for the quick lists
+ */
+static inline bool quick_list_push(header * ptr) {
+  int row = list_index(get_size(ptr));
+  if (row > N_QUICK_LISTS || row == N_LISTS - 1) {
+    return false;
+  }
+
+  malloc_lock * l = list_lock(row);
+  malloc_lock_acquire(l);
+  ptr->prev = QUICK_MARK;
+  ptr->next = quickLists[row];
+  quickLists[row] = ptr;
+  malloc_lock_release(l);
+
+  size_t bytes = __atomic_add_fetch(&quickListBytes, get_size(ptr),
+                                    __ATOMIC_RELAXED);
+  if (bytes > QUICK_LIST_BUDGET) {
+    malloc_lock_acquire(&tagLock);
+    consolidate_quick_lists();
+    malloc_lock_release(&tagLock);
+  }
+  return true;
+}
+
+/**
+ * @brief Empty every quick list, coalescing the blocks into the freelists.
+ *        The tag lock must be held.
+ *
+ * @return true if any block was consolidated
+ */
+static bool consolidate_quick_lists() {
+  bool consolidated = false;
+  for (int row = 1; row <= N_QUICK_LISTS && row < N_LISTS - 1; row++) {
+    if (!quickLists[row]) {
+      continue;
+    }
+
+    // Detach the whole list so the list lock is not held while coalescing
+    malloc_lock * l = list_lock(row);
+    malloc_lock_acquire(l);
+    header * ptr = quickLists[row];
+    quickLists[row] = NULL;
+    malloc_lock_release(l);
+
+    while (ptr) {
+      header * next = ptr->next;
+      ptr->prev = NULL;
+      __atomic_fetch_sub(&quickListBytes, get_size(ptr), __ATOMIC_RELAXED);
+      coalesce_object(ptr);
+      consolidated = true;
+      ptr = next;
+    }
+  }
+  return consolidated;
+}
+#endif
+
+/**
+ * @brief Helper to find the handle of an allocated block
+ *
+ * @param h The header of the block
+ *
+ * @return The block's handle or NULL if it was not allocated by my_halloc or
+ *         its handle was freed
+ */
+static inline my_handle block_handle(header * h) {
+  my_handle handle;
+  memcpy(&handle, (char *) h + get_size(h) - sizeof(handle), sizeof(handle));
+  // The last word of any other block is user data, so it is only followed if
+  // it points at an entry in the table
+  if (handle < handleTable || handle >= handleTable + numHandles ||
+      ((char *) handle - (char *) handleTable) % sizeof(*handle) != 0) {
+    return NULL;
   }
+  return handle->ptr == h->data ? handle : NULL;
+}
+
+/**
+ * @brief Helper to find the usable size of a tagged block, which excludes
+ *        the word holding the tag
+ *
+ * @param h The header of the block
+ */
+static inline size_t tagged_usable_size(header * h) {
+  return get_size(h) - ALLOC_HEADER_SIZE - sizeof(size_t);
+}
+
+/**
+ * @brief Helper to read the tag from the last word of a tagged block
+ *
+ * @param h The header of the block
+ */
+static inline unsigned block_tag(header * h) {
+  size_t tag;
+  memcpy(&tag, (char *) h + get_size(h) - sizeof(tag), sizeof(tag));
+  return tag;
+}
+
+/**
+ * @brief Helper to find the tag of an allocation returned to the user
+ *
+ * @param p The allocation
+ *
+ * @return The tag or 0 if it was not made by my_malloc_tagged
+ */
+static unsigned allocation_tag(void * p) {
+#if GUARD_SAMPLE_RATE > 0
+  // Sampled allocations have no header
+  if (guard_find_slot(p)) {
+    return 0;
+  }
+#endif
+  header * h = ptr_to_header(p);
+  return h->size_state & TAGGED_BIT ? block_tag(h) : 0;
+}
+
+/**
+ * @brief Helper to take a tagged block being freed out of its tag's counters
+ *
+ * @param h The header of the block, already validated as allocated
+ */
+static void untag_block(header * h) {
+  tag_counters * c = &tagCounters[block_tag(h)];
+  h->size_state &= ~(size_t) TAGGED_BIT;
+  __atomic_fetch_sub(&c->live_bytes, tagged_usable_size(h), __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&c->live_allocations, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Move an allocated block to the start of the free block on its left,
+ *        leaving the free block on the right of it. Every lock must be held.
+ *
+ * @param free_block The free block, already isolated from its freelist
+ * @param block The unpinned handle block right of it
+ * @param handle The block's handle
+ *
+ * @return The free block at its new position
+ */
+static header * slide_block(header * free_block, header * block, my_handle handle) {
+  size_t free_size = get_size(free_block);
+  size_t block_size = get_size(block);
+  size_t left_size = free_block->left_size;
+  header * right = get_right_header(block);
+
+  // The block's header and its handle in the last word move with it
+  memmove(free_block, block, block_size);
+  header * moved = free_block;
+  moved->left_size = left_size;
+  handle->ptr = moved->data;
+
+  free_block = get_header_from_offset(moved, block_size);
+  set_size_and_state(free_block, free_size, UNALLOCATED);
+  free_block->left_size = block_size;
+  free_block->next = NULL;
+  free_block->prev = NULL;
+  right->left_size = free_size;
+  return free_block;
+}
+
+/**
+ * @brief Slide the unpinned handle blocks of a run towards its start so the
+ *        free blocks they were separated by coalesce. Every lock must be held.
+ *
+ * @param first The first fencepost of the run
+ *
+ * @return The number of blocks moved
+ */
+static size_t compact_run(header * first) {
+  size_t moved = 0;
+  for (header * h = get_right_header(first); get_state(h) != FENCEPOST;
+       h = get_right_header(h)) {
+    if (get_state(h) != UNALLOCATED) {
+      continue;
+    }
+
+    // Absorb free blocks and pull handle blocks in until a block that cannot
+    // move is reached
+    isolate(h);
+    bool slid = false;
+    for (;;) {
+      header * right = get_right_header(h);
+      my_handle handle = NULL;
+      if (get_state(right) == UNALLOCATED) {
+        isolate(right);
+        set_size(h, get_size(h) + get_size(right));
+        get_right_header(h)->left_size = get_size(h);
+        memset(right, 0, sizeof(header));
+      } else if (get_state(right) == ALLOCATED &&
+                 (handle = block_handle(right)) && handle->pins == 0) {
+        h = slide_block(h, right, handle);
+        slid = true;
+        moved++;
+      } else {
+        break;
+      }
+    }
+    // The free block now covers the data of the blocks that moved through it
+    if (slid) {
+      zero_block((char *) h + sizeof(header), get_size(h) - sizeof(header));
+    }
+    insert(h);
+#if BACKGROUND_INTERVAL_MS > 0
+    stamp_free_block(h);
+#endif
+  }
+  return moved;
 }
 
 /**
@@ -505,7 +1961,8 @@ static inline header * verify_chunk(header * chunk) {
 		return chunk;
 	}
 	
-	for (; get_state(chunk) != FENCEPOST; chunk = get_right_header(chunk)) {
+	for (chunk = get_right_header(chunk); get_state(chunk) != FENCEPOST;
+	     chunk = get_right_header(chunk)) {
 		if (get_size(chunk)  != get_right_header(chunk)->left_size) {
 			fprintf(stderr, "Invalid sizes\n");
 			print_object(chunk);
@@ -526,38 +1983,303 @@ static inline bool verify_tags() {
   for (size_t i = 0; i < numOsChunks; i++) {
     header * invalid = verify_chunk(osChunkList[i]);
     if (invalid != NULL) {
-      return invalid;
+      return false;
     }
   }
 
+  return true;
+}
+
+/**
+ * @brief Helper to keep the verification cursor on a block boundary when the
+ *        block under it is absorbed by a coalesce. The tag lock must be held.
+ *
+ * @param from The absorbed block
+ * @param to The block it was merged into
+ */
+static inline void verify_cursor_moved(header * from, header * to) {
+  if (verifyCursor.block == from) {
+    verifyCursor.block = to;
+  }
+}
+
+/**
+ * @brief Helper to check that a freelist link points either at the list's
+ *        sentinel or at a free block in the heap belonging to the same list
+ *
+ * @param h The pointer taken from a next or prev field
+ * @param index The index of the list the link was read from
+ *
+ * @return true if the link is valid
+ */
+static inline bool verify_link(header * h, int index) {
+  if (h == &freelistSentinels[index]) {
+    return true;
+  }
+  if (!find_heap_run(h)) {
+    return false;
+  }
+  return get_state(h) == UNALLOCATED && list_index(get_size(h)) == index;
+}
+
+/**
+ * @brief Helper to verify a single block's boundary tags and, when it is
+ *        free, its freelist pointers. The tag lock must be held.
+ *
+ * @param h The block to verify, never a fencepost
+ *
+ * @return true if the block is valid
+ */
+static bool verify_block(header * h) {
+  heap_run * run = find_heap_run(h);
+  if (!run || !is_heap_block(h, run)) {
+    fprintf(stderr, "Invalid sizes\n");
+    print_object(h);
+    return false;
+  }
+  if (get_state(h) != UNALLOCATED && get_state(h) != ALLOCATED) {
+    fprintf(stderr, "Invalid state\n");
+    print_object(h);
+    return false;
+  }
+  if (get_state(h) == ALLOCATED) {
+    return true;
+  }
+
+  // Exact fits can still take the block, so its list is locked before its
+  // state and pointers are read again
+  int index = list_index(get_size(h));
+  malloc_lock * l = list_lock(index);
+  malloc_lock_acquire(l);
+  bool valid = get_state(h) != UNALLOCATED ||
+               (verify_link(h->next, index) && verify_link(h->prev, index) &&
+                h->next->prev == h && h->prev->next == h);
+  malloc_lock_release(l);
+
+  if (!valid) {
+    fprintf(stderr, "Invalid pointers\n");
+    print_object(h);
+  }
+  return valid;
+}
+
+#if VERIFY_EVERY_N_FREES > 0 || VERIFY_INTERVAL_MS > 0
+/**
+ * @brief Verify the next VERIFY_STEP_BUDGET blocks, stopping the program if
+ *        the heap is corrupt
+ */
+static void verify_or_abort() {
+  if (!my_verify_step(VERIFY_STEP_BUDGET)) {
+    puts("Heap Corruption Detected");
+    assert(false);
+  }
+}
+#endif
+
+#if VERIFY_INTERVAL_MS > 0
+/**
+ * @brief Body of the background thread verifying the heap a few blocks at a
+ *        time
+ */
+static void * verify_thread(void * arg) {
+  (void) arg;
+  struct timespec interval = {
+    .tv_sec = VERIFY_INTERVAL_MS / 1000,
+    .tv_nsec = (VERIFY_INTERVAL_MS % 1000) * 1000000L,
+  };
+  for (;;) {
+    nanosleep(&interval, NULL);
+    verify_or_abort();
+  }
   return NULL;
 }
+#endif
 
 /**
- * @brief Initialize mutex lock and prepare an initial chunk of memory for allocation
+ * @brief Helper to return the whole pages inside a free block to the OS,
+ *        keeping the page holding its header, freelist links and free time.
+ *        The tag lock and the block's list lock must be held.
+ *
+ * @param h The header of the block
+ * @param page The OS page size
+ *
+ * @return The number of bytes released
  */
-static void init() {
-  // Initialize mutex for thread safety
-  pthread_mutex_init(&mutex, NULL);
+static size_t purge_block(header * h, size_t page) {
+  char * start = (char *) (((uintptr_t) h + sizeof(header) + sizeof(size_t) +
+                            page - 1) & ~(page - 1));
+  char * end = (char *) (((uintptr_t) h + get_size(h)) & ~(page - 1));
+  if (end <= start || madvise(start, end - start, MADV_DONTNEED) != 0) {
+    return 0;
+  }
+#if BACKGROUND_INTERVAL_MS > 0
+  // Nothing is left to purge until the block takes in freed data again
+  *block_free_time(h) = 0;
+#endif
+  return end - start;
+}
 
-#ifdef DEBUG
-  // Manually set printf buffer so it won't call malloc when debugging the allocator
-  setvbuf(stdout, NULL, _IONBF, 0);
-#endif // DEBUG
+#if BACKGROUND_INTERVAL_MS > 0
+/**
+ * @brief Push a freed block onto the pending list for the background thread
+ *        to coalesce, coalescing the whole list if it exceeds
+ *        PENDING_FREE_BUDGET bytes
+ *
+ * @param ptr The header of the block being freed
+ */
+static inline void pending_push(header * ptr) {
+  if (ptr->prev == PENDING_MARK) {
+    puts("Double Free Detected");
+    assert(false);
+  }
+  ptr->prev = PENDING_MARK;
+
+  header * head = __atomic_load_n(&pendingFrees, __ATOMIC_RELAXED);
+  do {
+    ptr->next = head;
+  } while (!__atomic_compare_exchange_n(&pendingFrees, &head, ptr, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+  size_t bytes = __atomic_add_fetch(&pendingBytes, get_size(ptr), __ATOMIC_RELAXED);
+  if (bytes > PENDING_FREE_BUDGET) {
+    malloc_lock_acquire(&tagLock);
+    drain_pending_frees();
+    malloc_lock_release(&tagLock);
+  }
+}
+
+/**
+ * @brief Coalesce every block on the pending list into the freelists. The
+ *        tag lock must be held.
+ *
+ * @return The number of bytes coalesced
+ */
+static size_t drain_pending_frees() {
+  // Only ever detached whole, so a block cannot be popped and pushed again
+  // while another thread is pushing
+  header * ptr = __atomic_exchange_n(&pendingFrees, NULL, __ATOMIC_ACQUIRE);
+  size_t drained = 0;
+  while (ptr) {
+    header * next = ptr->next;
+    ptr->prev = NULL;
+    drained += get_size(ptr);
+    coalesce_object(ptr);
+    ptr = next;
+  }
+  if (drained) {
+    __atomic_fetch_sub(&pendingBytes, drained, __ATOMIC_RELAXED);
+  }
+  return drained;
+}
+
+/**
+ * @brief Return the pages of every free block that has gone PURGE_DECAY_MS
+ *        without being coalesced with a newly freed block
+ *
+ * @param now The purge clock
+ *
+ * @return The number of bytes released
+ */
+static size_t purge_idle_blocks(size_t now) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t released = 0;
+  // Blocks in the exact size lists are allocated without the tag lock, but
+  // none of them are large enough to hold a whole page
+  malloc_lock_acquire(&tagLock);
+  for (int i = EXACT_LISTS; i < N_LISTS; i++) {
+    malloc_lock * l = list_lock(i);
+    malloc_lock_acquire(l);
+    header * freelist = &freelistSentinels[i];
+    for (header * h = freelist->next; h != freelist; h = h->next) {
+      size_t * freed = block_free_time(h);
+      if (freed && *freed && now - *freed >= PURGE_DECAY_MS) {
+        released += purge_block(h, page);
+      }
+    }
+    malloc_lock_release(l);
+  }
+  malloc_lock_release(&tagLock);
+  return released;
+}
+
+/**
+ * @brief Body of the background thread, which coalesces pending blocks
+ *        every BACKGROUND_INTERVAL_MS and purges the pages of free blocks
+ *        once they have sat unchanged for PURGE_DECAY_MS
+ */
+static void * background_thread(void * arg) {
+  (void) arg;
+  struct timespec interval = {
+    .tv_sec = BACKGROUND_INTERVAL_MS / 1000,
+    .tv_nsec = (BACKGROUND_INTERVAL_MS % 1000) * 1000000L,
+  };
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  // Free blocks are scanned a few times per decay period rather than every
+  // interval, so a block is purged at most a quarter period late
+  size_t scanEvery = PURGE_DECAY_MS / 4 > BACKGROUND_INTERVAL_MS ?
+                     PURGE_DECAY_MS / 4 : BACKGROUND_INTERVAL_MS;
+  size_t nextScan = 0;
+  for (;;) {
+    nanosleep(&interval, NULL);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    size_t now = 1 + (ts.tv_sec - start.tv_sec) * 1000 +
+                 (ts.tv_nsec - start.tv_nsec) / 1000000;
+    __atomic_store_n(&purgeClock, now, __ATOMIC_RELAXED);
+
+    malloc_lock_acquire(&tagLock);
+    drain_pending_frees();
+    malloc_lock_release(&tagLock);
+
+    if (now >= nextScan) {
+      purge_idle_blocks(now);
+      nextScan = now + scanEvery;
+    }
+  }
+  return NULL;
+}
+#endif
+
+/**
+ * @brief Initialize every lock the allocator uses
+ */
+static void init_locks() {
+#if GUARD_SAMPLE_RATE > 0
+  malloc_lock_init(&guardLock);
+#endif
+  malloc_lock_init(&handleLock);
+  malloc_lock_init(&chunkLock);
+  malloc_lock_init(&tagLock);
+#if THREAD_LINES
+  malloc_lock_init(&threadCacheLock);
+#endif
+  for (int i = 0; i < N_LIST_LOCKS; i++) {
+    malloc_lock_init(&listLocks[i].lock);
+  }
+}
 
+/**
+ * @brief Empty the freelists and fill them with a fresh chunk from the OS
+ *
+ * @return The free block in the new chunk
+ */
+static header * init_arena() {
   // Allocate the first chunk from the OS
   header * block = allocate_chunk(ARENA_SIZE);
 
   header * prevFencePost = get_header_from_offset(block, -ALLOC_HEADER_SIZE);
   insert_os_chunk(prevFencePost);
+  page_map_set(&pageMap, prevFencePost, ARENA_SIZE,
+               new_heap_run((char *) prevFencePost, ARENA_SIZE));
 
   lastFencePost = get_header_from_offset(block, get_size(block));
-
-  // Set the base pointer to the beginning of the first fencepost in the first
-  // chunk from the OS
-  base = ((char *) block) - ALLOC_HEADER_SIZE; //sizeof(header);
+  heapSize = ARENA_SIZE;
 
   // Initialize freelist sentinels
+#if FIT_POLICY == FIT_NEXT
+  fitRover = NULL;
+#endif
   for (int i = 0; i < N_LISTS; i++) {
     header * freelist = &freelistSentinels[i];
     freelist->next = freelist;
@@ -565,40 +2287,1204 @@ static void init() {
   }
 
   // Insert first chunk into the free list
-  header * freelist = &freelistSentinels[N_LISTS - 1];
+  header * freelist = &freelistSentinels[list_index(get_size(block))];
   freelist->next = block;
   freelist->prev = block;
   block->next = freelist;
   block->prev = freelist;
+  return block;
 }
 
-/* 
- * External interface
+#if MALLOC_FORK_RESET
+/**
+ * @brief Take every lock before forking so the child inherits the heap in a
+ *        consistent state
  */
-void * my_malloc(size_t size) {
-  pthread_mutex_lock(&mutex);
-  header * hdr = allocate_object(size); 
-  pthread_mutex_unlock(&mutex);
-  return hdr;
+static void fork_prepare() {
+  malloc_lock_acquire(&chunkLock);
+  malloc_lock_acquire(&tagLock);
+  for (int i = 0; i < N_LIST_LOCKS; i++) {
+    malloc_lock_acquire(&listLocks[i].lock);
+  }
 }
 
-void * my_calloc(size_t nmemb, size_t size) {
-  return memset(my_malloc(size * nmemb), 0, size * nmemb);
+/**
+ * @brief Release the locks taken by fork_prepare in the parent
+ */
+static void fork_parent() {
+  for (int i = N_LIST_LOCKS - 1; i >= 0; i--) {
+    malloc_lock_release(&listLocks[i].lock);
+  }
+  malloc_lock_release(&tagLock);
+  malloc_lock_release(&chunkLock);
 }
 
-void * my_realloc(void * ptr, size_t size) {
-  void * mem = my_malloc(size);
-  memcpy(mem, ptr, size);
-  my_free(ptr);
-  return mem; 
-}
+/**
+ * @brief Give the child a fresh arena instead of the inherited freelists.
+ *        Every write to an inherited page would copy it, so the inherited
+ *        heap is only ever read and its blocks are leaked when freed.
+ */
+static void fork_child() {
+  init_locks();
+  heapGeneration++;
+  numOsChunks = 0;
+  memset(&verifyCursor, 0, sizeof(verifyCursor));
+#if THREAD_LINES
+  // The forking thread's spans are in the inherited heap and the other
+  // threads are gone, the forking thread is listed again by its next span
+  memset(threadSpans, 0, sizeof(threadSpans));
+  threadCaches = NULL;
+  threadSpansRegistered = false;
+#endif
 
-void my_free(void * p) {
-  pthread_mutex_lock(&mutex);
-  deallocate_object(p);
-  pthread_mutex_unlock(&mutex);
+#if N_QUICK_LISTS > 0
+  for (int i = 0; i <= N_QUICK_LISTS; i++) {
+    quickLists[i] = NULL;
+  }
+  quickListBytes = 0;
+#endif
+#if BACKGROUND_INTERVAL_MS > 0
+  // Pending blocks are in the inherited heap, and without the background
+  // thread frees are coalesced once the pending list exceeds its budget
+  pendingFrees = NULL;
+  pendingBytes = 0;
+#endif
+
+  // Start the new arena on a fresh page so it shares no page with the
+  // inherited heap
+  size_t page = sysconf(_SC_PAGESIZE);
+#if ARENA_MMAP
+  regionNext = (char *) (((uintptr_t) regionNext + page - 1) & ~(page - 1));
+  if (regionNext > regionEnd) {
+    regionNext = regionEnd;
+  }
+#else
+  uintptr_t brk = (uintptr_t) sbrk(0);
+  if (brk & (page - 1)) {
+    sbrk(page - (brk & (page - 1)));
+  }
+#endif
+  init_arena();
 }
+#endif
 
-bool verify() {
-  return verify_freelist() && verify_tags();
+/**
+ * @brief Initialize the lock and prepare an initial chunk of memory for allocation
+ */
+static void init() {
+  // Initialize the locks for thread safety
+  init_locks();
+
+#ifdef DEBUG
+  // Manually set printf buffer so it won't call malloc when debugging the allocator
+  setvbuf(stdout, NULL, _IONBF, 0);
+#endif // DEBUG
+
+  header * block = init_arena();
+
+  // Set the base pointer to the beginning of the first fencepost in the first
+  // chunk from the OS
+  base = ((char *) block) - ALLOC_HEADER_SIZE; //sizeof(header);
+
+#if MALLOC_FORK_RESET
+  pthread_atfork(fork_prepare, fork_parent, fork_child);
+#endif
+
+#if VERIFY_INTERVAL_MS > 0
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, verify_thread, NULL) == 0) {
+    pthread_detach(thread);
+  }
+#endif
+#if BACKGROUND_INTERVAL_MS > 0
+  pthread_t background;
+  if (pthread_create(&background, NULL, background_thread, NULL) == 0) {
+    pthread_detach(background);
+  }
+#endif
+}
+
+#if GUARD_SAMPLE_RATE > 0
+/**
+ * @brief Pick the number of allocations until the calling thread next
+ *        samples one, uniformly from [1, 2 * GUARD_SAMPLE_RATE - 1] so the
+ *        sampled allocations do not line up with a program's own patterns
+ */
+static inline uint32_t guard_next_interval() {
+  if (!guardRandom) {
+    guardRandom = (uint32_t) (uintptr_t) &guardRandom | 1;
+  }
+  guardRandom ^= guardRandom << 13;
+  guardRandom ^= guardRandom >> 17;
+  guardRandom ^= guardRandom << 5;
+  return 1 + guardRandom % (2 * GUARD_SAMPLE_RATE - 1);
+}
+
+/**
+ * @brief Decide whether to sample an allocation, roughly one in
+ *        GUARD_SAMPLE_RATE allocations that fit in a page are sampled
+ *
+ * @param size The size requested by the user
+ *
+ * @return true if the allocation should be placed in a guard slot
+ */
+static inline bool guard_should_sample(size_t size) {
+  // A thread's first interval is random too, otherwise many short lived
+  // threads would each sample their first allocation and drain the slots
+  if (guardCountdown == 0) {
+    guardCountdown = guard_next_interval();
+  }
+  if (guardCountdown > 1) {
+    guardCountdown--;
+    return false;
+  }
+
+  // The sample waits for an allocation that fits in a slot rather than
+  // being spent on one that does not
+  if (size == 0 || size > (size_t) sysconf(_SC_PAGESIZE)) {
+    return false;
+  }
+  guardCountdown = guard_next_interval();
+  return true;
+}
+
+/**
+ * @brief Reserve the guard region and install the fault handler reporting
+ *        accesses to it, the guard lock must be held
+ *
+ * @return false if the OS is out of memory
+ */
+static bool guard_init() {
+  guardPageSize = sysconf(_SC_PAGESIZE);
+  char * region = mmap(NULL, (2 * GUARD_SLOTS + 1) * guardPageSize, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    return false;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = guard_segv_handler;
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &guardPreviousAction);
+
+  __atomic_store_n(&guardRegion, region, __ATOMIC_RELEASE);
+  return true;
+}
+
+/**
+ * @brief Place an allocation at the end of a free slot's page so the guard
+ *        page after it catches overflows. The bytes rounding the size up to
+ *        MALLOC_ALIGNMENT are filled with a canary checked on free.
+ *
+ * @param size The size requested by the user, at most a page
+ *
+ * @return The allocation or NULL if every slot is in use
+ */
+static void * guard_alloc(size_t size) {
+  malloc_lock_acquire(&guardLock);
+  if (!guardRegion && !guard_init()) {
+    malloc_lock_release(&guardLock);
+    return NULL;
+  }
+
+  guard_slot * slot = NULL;
+  size_t i = 0;
+  for (size_t n = 0; n < GUARD_SLOTS; n++) {
+    i = (guardNextSlot + n) % GUARD_SLOTS;
+    if (!guardSlots[i].allocated) {
+      slot = &guardSlots[i];
+      break;
+    }
+  }
+  if (!slot) {
+    malloc_lock_release(&guardLock);
+    return NULL;
+  }
+  guardNextSlot = (i + 1) % GUARD_SLOTS;
+
+  char * page = guardRegion + (2 * i + 1) * guardPageSize;
+  if (mprotect(page, guardPageSize, PROT_READ | PROT_WRITE) != 0) {
+    malloc_lock_release(&guardLock);
+    return NULL;
+  }
+
+  size_t rounded = (size + MALLOC_ALIGNMENT - 1) & ~(size_t) (MALLOC_ALIGNMENT - 1);
+  slot->ptr = page + guardPageSize - rounded;
+  slot->size = size;
+  slot->allocated = true;
+  slot->used = true;
+  // Match the zeroed memory handed out by the rest of the allocator
+  memset(page, 0, guardPageSize);
+  memset(slot->ptr + size, GUARD_CANARY, rounded - size);
+  malloc_lock_release(&guardLock);
+  return slot->ptr;
+}
+
+/**
+ * @brief Find the guard slot a pointer returned by my_malloc lies in
+ *
+ * @param p The pointer to look up
+ *
+ * @return The slot or NULL if p is not in the guard region
+ */
+static inline guard_slot * guard_find_slot(void * p) {
+  char * region = __atomic_load_n(&guardRegion, __ATOMIC_ACQUIRE);
+  if (!region || (char *) p < region ||
+      (char *) p >= region + (2 * GUARD_SLOTS + 1) * guardPageSize) {
+    return NULL;
+  }
+  size_t page = ((char *) p - region) / guardPageSize;
+  return page % 2 ? &guardSlots[page / 2] : NULL;
+}
+
+/**
+ * @brief Free a sampled allocation, checking its canary and protecting its
+ *        page so any later access faults
+ *
+ * @param slot The slot p lies in
+ * @param p The pointer being freed
+ */
+static void guard_free(guard_slot * slot, void * p) {
+  malloc_lock_acquire(&guardLock);
+  if (!slot->allocated) {
+    malloc_lock_release(&guardLock);
+    guard_report("double free", slot, p);
+    puts("Double Free Detected");
+    assert(false);
+    return;
+  }
+  if (p != slot->ptr) {
+    malloc_lock_release(&guardLock);
+    guard_report("invalid free", slot, p);
+    puts("Invalid Free Detected");
+    return;
+  }
+
+  size_t rounded = (slot->size + MALLOC_ALIGNMENT - 1) & ~(size_t) (MALLOC_ALIGNMENT - 1);
+  for (size_t i = slot->size; i < rounded; i++) {
+    if ((unsigned char) slot->ptr[i] != GUARD_CANARY) {
+      malloc_lock_release(&guardLock);
+      guard_report("buffer overflow detected on free", slot, slot->ptr + i);
+      abort();
+    }
+  }
+
+  slot->allocated = false;
+  mprotect(slot->ptr - ((uintptr_t) slot->ptr & (guardPageSize - 1)),
+           guardPageSize, PROT_NONE);
+  malloc_lock_release(&guardLock);
+}
+
+/**
+ * @brief Write a number to stderr without allocating so it can be used from
+ *        a signal handler
+ */
+static void guard_write_number(size_t n) {
+  char buf[32];
+  size_t i = sizeof(buf);
+  do {
+    buf[--i] = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  write(2, buf + i, sizeof(buf) - i);
+}
+
+static void guard_write(const char * str) {
+  write(2, str, strlen(str));
+}
+
+/**
+ * @brief Describe a bad access to a sampled allocation on stderr
+ *
+ * @param what The kind of error
+ * @param slot The slot of the allocation involved
+ * @param addr The address accessed or freed
+ */
+static void guard_report(const char * what, guard_slot * slot, char * addr) {
+  guard_write("GUARD: ");
+  guard_write(what);
+  guard_write(" at offset ");
+  if (addr < slot->ptr) {
+    guard_write("-");
+    guard_write_number(slot->ptr - addr);
+  } else {
+    guard_write_number(addr - slot->ptr);
+  }
+  guard_write(" of a ");
+  guard_write_number(slot->size);
+  guard_write(slot->allocated ? " byte allocation\n" : " byte freed allocation\n");
+}
+
+/**
+ * @brief Report faults in the guard region and then crash through the
+ *        previous handler
+ */
+static void guard_segv_handler(int sig, siginfo_t * info, void * ucontext) {
+  char * addr = (char *) info->si_addr;
+  char * region = guardRegion;
+  size_t size = (2 * GUARD_SLOTS + 1) * guardPageSize;
+  if (region && addr >= region && addr < region + size) {
+    size_t page = (addr - region) / guardPageSize;
+    if (page % 2) {
+      guard_report("use after free", &guardSlots[page / 2], addr);
+    } else {
+      // A guard page belongs to the closest slot that was ever used, an
+      // overflow off the end of the slot on its left is the most likely
+      size_t left = page / 2 - 1;
+      size_t right = page / 2;
+      if (page > 0 && guardSlots[left].used) {
+        guard_report("buffer overflow", &guardSlots[left], addr);
+      } else if (right < GUARD_SLOTS && guardSlots[right].used) {
+        guard_report("buffer underflow", &guardSlots[right], addr);
+      }
+    }
+  }
+
+  // Returning retries the access with the previous handler in place
+  sigaction(SIGSEGV, &guardPreviousAction, NULL);
+  if (!(guardPreviousAction.sa_flags & SA_SIGINFO) &&
+      guardPreviousAction.sa_handler != SIG_DFL &&
+      guardPreviousAction.sa_handler != SIG_IGN) {
+    guardPreviousAction.sa_handler(sig);
+  } else if (guardPreviousAction.sa_flags & SA_SIGINFO) {
+    guardPreviousAction.sa_sigaction(sig, info, ucontext);
+  }
+}
+#endif
+
+#if THREAD_LINES
+/**
+ * @brief Allocate a small object from the calling thread's span for its
+ *        size, starting a new span when the current one is full
+ *
+ * @param size The size requested by the user, at most THREAD_LINES_MAX
+ *
+ * @return The object or NULL if the heap is out of memory
+ */
+static void * line_alloc(size_t size) {
+  int cls = (int) ((size + 15) / 16);
+  size_t slot = ALLOC_HEADER_SIZE + (size_t) cls * 16;
+
+  line_span * span = threadSpans[cls];
+  header * h = NULL;
+  if (span) {
+    malloc_lock_acquire(&span->lock);
+    if (span->free) {
+      h = span->free;
+      span->free = h->next;
+      // The link is the one word of a freed object that was not zeroed
+      h->next = NULL;
+    } else if (span->bump + slot <= span->end) {
+      h = (header *) span->bump;
+      span->bump += slot;
+    }
+    if (h) {
+      span->used++;
+    }
+    malloc_lock_release(&span->lock);
+    if (h) {
+      set_size_and_state(h, slot, SPAN_OBJECT);
+      h->left_size = (char *) h - (char *) span;
+      return h->data;
+    }
+    malloc_lock_acquire(&threadCacheLock);
+    threadSpans[cls] = NULL;
+    malloc_lock_release(&threadCacheLock);
+    retire_span(span);
+  }
+
+  if (!threadSpansRegistered) {
+    pthread_once(&threadSpanKeyOnce, create_thread_span_key);
+    pthread_setspecific(threadSpanKey, &threadSpansRegistered);
+    threadSpansRegistered = true;
+    threadCache.spans = threadSpans;
+    malloc_lock_acquire(&threadCacheLock);
+    threadCache.prev = NULL;
+    threadCache.next = threadCaches;
+    if (threadCaches) {
+      threadCaches->prev = &threadCache;
+    }
+    threadCaches = &threadCache;
+    malloc_lock_release(&threadCacheLock);
+  }
+  span = my_aligned_alloc(CACHE_LINE_SIZE, THREAD_SPAN_SIZE);
+  if (!span) {
+    return NULL;
+  }
+  malloc_lock_init(&span->lock);
+  span->self = span;
+  h = (header *) ((char *) span + LINE_SPAN_HEADER);
+  span->free = NULL;
+  span->bump = (char *) h + slot;
+  span->end = (char *) span + THREAD_SPAN_SIZE;
+  span->used = 1;
+  span->current = true;
+  malloc_lock_acquire(&threadCacheLock);
+  threadSpans[cls] = span;
+  malloc_lock_release(&threadCacheLock);
+
+  set_size_and_state(h, slot, SPAN_OBJECT);
+  h->left_size = (char *) h - (char *) span;
+  return h->data;
+}
+
+/**
+ * @brief Helper to find the span an object was carved from without trusting
+ *        a header that may not belong to an object
+ *
+ * @param h The header of a pointer passed to my_free
+ *
+ * @return The span or NULL if h is not the header of a span object
+ */
+static inline line_span * line_span_of(header * h) {
+  heap_run * run = find_heap_run(h);
+  if (!run || get_state(h) != SPAN_OBJECT || h->left_size >= THREAD_SPAN_SIZE) {
+    return NULL;
+  }
+  line_span * span = (line_span *) ((char *) h - h->left_size);
+  if ((char *) span < run->start || span->self != span) {
+    return NULL;
+  }
+  return span;
+}
+
+/**
+ * @brief Return an object to its span, from any thread
+ *
+ * @param h The header of the object
+ * @param span The span it was carved from
+ */
+static void line_free(header * h, line_span * span) {
+#if MALLOC_FORK_RESET
+  // Spans inherited across a fork are leaked rather than copying the page
+  if (find_heap_run((header *) span)->generation != heapGeneration) {
+    return;
+  }
+#endif
+#if ZERO_ON_FREE
+  memset(h->data, 0, get_size(h) - ALLOC_HEADER_SIZE);
+#endif
+  // A second free of the object no longer finds its span
+  set_state(h, UNALLOCATED);
+  malloc_lock_acquire(&span->lock);
+  h->next = span->free;
+  span->free = h;
+  bool empty = --span->used == 0 && !span->current;
+  malloc_lock_release(&span->lock);
+  if (empty) {
+    deallocate_object(span);
+  }
+}
+
+/**
+ * @brief Stop allocating from a span, it is returned to the heap at once if
+ *        it is empty or by the free of its last object otherwise
+ *
+ * @param span The span to retire
+ */
+static void retire_span(line_span * span) {
+  malloc_lock_acquire(&span->lock);
+  span->current = false;
+  bool empty = span->used == 0;
+  malloc_lock_release(&span->lock);
+  if (empty) {
+    deallocate_object(span);
+  }
+}
+
+/**
+ * @brief Thread exit destructor retiring every span of the thread
+ *
+ * @param unused The value registered with the key
+ */
+static void release_thread_spans(void * unused) {
+  (void) unused;
+  line_span * spans[LINE_CLASSES + 1];
+  malloc_lock_acquire(&threadCacheLock);
+  if (threadCache.prev) {
+    threadCache.prev->next = threadCache.next;
+  } else if (threadCaches == &threadCache) {
+    threadCaches = threadCache.next;
+  }
+  if (threadCache.next) {
+    threadCache.next->prev = threadCache.prev;
+  }
+  threadCache.next = threadCache.prev = NULL;
+  memcpy(spans, threadSpans, sizeof(spans));
+  memset(threadSpans, 0, sizeof(threadSpans));
+  malloc_lock_release(&threadCacheLock);
+
+  for (int i = 0; i <= LINE_CLASSES; i++) {
+    if (spans[i]) {
+      retire_span(spans[i]);
+    }
+  }
+}
+
+static void create_thread_span_key(void) {
+  pthread_key_create(&threadSpanKey, release_thread_spans);
+}
+#endif
+
+/* 
+ * External interface
+ */
+void * my_malloc(size_t size) {
+#if GUARD_SAMPLE_RATE > 0
+  if (guard_should_sample(size)) {
+    void * p = guard_alloc(size);
+    if (p) return p;
+  }
+#endif
+#if THREAD_LINES
+  if (size > 0 && size <= THREAD_LINES_MAX) {
+    return line_alloc(size);
+  }
+#endif
+  return allocate_object(size);
+}
+
+void * my_calloc(size_t nmemb, size_t size) {
+  size_t total;
+  if (__builtin_mul_overflow(nmemb, size, &total)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  void * mem = my_malloc(total);
+  if (!mem) {
+    return NULL;
+  }
+  return memset(mem, 0, total);
+}
+
+void * my_realloc(void * ptr, size_t size) {
+  if (!ptr) {
+    return my_malloc(size);
+  }
+  // Reallocating to nothing frees the block
+  if (size == 0) {
+    my_free(ptr);
+    return NULL;
+  }
+
+  // Growing into the slack at the end of the block needs no copy, as does
+  // shrinking by less than a new block would save
+  size_t old_size = my_malloc_usable_size(ptr);
+  if (size <= old_size && old_size - size < sizeof(header) + MALLOC_ALIGNMENT) {
+    return ptr;
+  }
+
+  // The new block keeps the old one's tag
+  void * mem = my_malloc_tagged(size, allocation_tag(ptr));
+  if (!mem) {
+    return NULL;
+  }
+
+  // Only copy as much of the old block as is in use
+  memcpy(mem, ptr, old_size < size ? old_size : size);
+  my_free(ptr);
+  return mem;
+}
+
+void my_free(void * p) {
+#if GUARD_SAMPLE_RATE > 0
+  guard_slot * slot = guard_find_slot(p);
+  if (slot) {
+    guard_free(slot, p);
+    return;
+  }
+#endif
+#if THREAD_LINES
+  line_span * span = p ? line_span_of(ptr_to_header(p)) : NULL;
+  if (span) {
+    line_free(ptr_to_header(p), span);
+    return;
+  }
+#endif
+  deallocate_object(p);
+
+#if VERIFY_EVERY_N_FREES > 0
+  if (--verifyCountdown == 0) {
+    verifyCountdown = VERIFY_EVERY_N_FREES;
+    verify_or_abort();
+  }
+#endif
+}
+
+void * my_aligned_alloc(size_t alignment, size_t size) {
+  if (alignment & (alignment - 1)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (alignment <= MALLOC_ALIGNMENT) {
+    return my_malloc(size);
+  }
+
+  // Leave room to move the start of the block forward by enough to split
+  // off a free block in front of it
+  size_t padded;
+  if (size == 0) {
+    return NULL;
+  }
+  if (__builtin_add_overflow(size, alignment + sizeof(header), &padded)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  char * p = (char *) allocate_object(padded);
+  if (!p) {
+    return NULL;
+  }
+
+  uintptr_t aligned = ((uintptr_t) p + alignment - 1) & ~(uintptr_t) (alignment - 1);
+  while (aligned != (uintptr_t) p && aligned - (uintptr_t) p < sizeof(header)) {
+    aligned += alignment;
+  }
+
+  // The size of the block the request needs, as allocate_object rounds it
+  size_t rounded = (size + MALLOC_ALIGNMENT - 1) & ~(size_t) (MALLOC_ALIGNMENT - 1);
+  size_t needed = ALLOC_HEADER_SIZE + rounded;
+  if (needed < sizeof(header)) {
+    needed = sizeof(header);
+  }
+
+  // The block is split under the tag lock as its neighbors may be
+  // coalescing into it
+  size_t lead = aligned - (uintptr_t) p;
+  header * h = ptr_to_header(p);
+  header * block = h;
+  malloc_lock_acquire(&tagLock);
+  if (lead) {
+    block = get_header_from_offset(h, lead);
+    set_size_and_state(block, get_size(h) - lead, ALLOCATED);
+    block->left_size = lead;
+    get_right_header(block)->left_size = get_size(block);
+    set_size(h, lead);
+    coalesce_object(h);
+  }
+
+  // The padding past the aligned block is freed too once it can hold a
+  // block of its own
+  size_t tail = get_size(block) - needed;
+  if (tail >= sizeof(header)) {
+    header * rest = get_header_from_offset(block, needed);
+    set_size_and_state(rest, tail, ALLOCATED);
+    rest->left_size = needed;
+    get_right_header(rest)->left_size = tail;
+    set_size(block, needed);
+    coalesce_object(rest);
+  }
+  malloc_lock_release(&tagLock);
+  return block->data;
+}
+
+size_t my_malloc_usable_size(void * p) {
+  if (!p) {
+    return 0;
+  }
+#if GUARD_SAMPLE_RATE > 0
+  // The padding after a sampled allocation holds the canary
+  guard_slot * slot = guard_find_slot(p);
+  if (slot) {
+    return slot->size;
+  }
+#endif
+  header * h = ptr_to_header(p);
+  if (h->size_state & TAGGED_BIT) {
+    return tagged_usable_size(h);
+  }
+  // The last word of a block from my_halloc points back at its handle
+  if (block_handle(h)) {
+    return get_size(h) - ALLOC_HEADER_SIZE - sizeof(my_handle);
+  }
+  return get_size(h) - ALLOC_HEADER_SIZE;
+}
+
+void * my_malloc_at_least(size_t size, size_t * actual) {
+  void * p = my_malloc(size);
+  if (actual) {
+    *actual = my_malloc_usable_size(p);
+  }
+  return p;
+}
+
+void * my_malloc_isolated(size_t size) {
+  // Whole lines so nothing else is placed after the object in its last line
+  size_t rounded;
+  if (__builtin_add_overflow(size, CACHE_LINE_SIZE - 1, &rounded)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  rounded &= ~(size_t) (CACHE_LINE_SIZE - 1);
+  return my_aligned_alloc(CACHE_LINE_SIZE, rounded);
+}
+
+/**
+ * @brief Helper to add a lock's telemetry to the statistics
+ *
+ * @param stats The statistics to add to
+ * @param l The lock to read
+ */
+static void add_lock_stats(alloc_stats * stats, malloc_lock * l) {
+  malloc_lock_acquire(l);
+  // Exclude this acquisition from the reported counts
+  stats->lock_acquisitions += l->acquisitions - 1;
+  stats->lock_contended += l->contended;
+  stats->lock_wait_cycles += l->wait_cycles;
+  malloc_lock_release(l);
+}
+
+void my_malloc_stats(alloc_stats * stats) {
+  memset(stats, 0, sizeof(alloc_stats));
+  add_lock_stats(stats, &chunkLock);
+  add_lock_stats(stats, &tagLock);
+  for (int i = 0; i < N_LIST_LOCKS; i++) {
+    add_lock_stats(stats, &listLocks[i].lock);
+  }
+  stats->heap_bytes = __atomic_load_n(&pageMap.pages, __ATOMIC_RELAXED)
+                      << PAGEMAP_PAGE_SHIFT;
+  stats->verify_passes = __atomic_load_n(&verifyCursor.passes, __ATOMIC_RELAXED);
+}
+
+void * my_malloc_tagged(size_t size, unsigned tag) {
+  if (tag == 0) {
+    return my_malloc(size);
+  }
+  if (tag >= MAX_TAGS) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  // Leave room for the tag in the last word of the block
+  size_t padded;
+  if (size == 0) {
+    return NULL;
+  }
+  if (__builtin_add_overflow(size, sizeof(size_t), &padded)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  void * p = allocate_object(padded);
+  if (!p) {
+    return NULL;
+  }
+  header * h = ptr_to_header(p);
+  size_t word = tag;
+  memcpy((char *) h + get_size(h) - sizeof(word), &word, sizeof(word));
+  // No other thread writes the header of an allocated block
+  h->size_state |= TAGGED_BIT;
+
+  tag_counters * c = &tagCounters[tag];
+  __atomic_fetch_add(&c->live_bytes, tagged_usable_size(h), __ATOMIC_RELAXED);
+  __atomic_fetch_add(&c->live_allocations, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&c->total_allocations, 1, __ATOMIC_RELAXED);
+  return p;
+}
+
+bool my_malloc_tag_name(unsigned tag, const char * name) {
+  if (tag >= MAX_TAGS) {
+    errno = EINVAL;
+    return false;
+  }
+  __atomic_store_n(&tagCounters[tag].name, name, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool my_malloc_tag_stats(unsigned tag, tag_stats * stats) {
+  if (tag >= MAX_TAGS) {
+    errno = EINVAL;
+    return false;
+  }
+  tag_counters * c = &tagCounters[tag];
+  stats->name = __atomic_load_n(&c->name, __ATOMIC_ACQUIRE);
+  stats->live_bytes = __atomic_load_n(&c->live_bytes, __ATOMIC_RELAXED);
+  stats->live_allocations = __atomic_load_n(&c->live_allocations, __ATOMIC_RELAXED);
+  stats->total_allocations = __atomic_load_n(&c->total_allocations, __ATOMIC_RELAXED);
+  return true;
+}
+
+/**
+ * @brief Helper to count the blocks of a chunk. The tag lock must be held.
+ *
+ * @param fencepost The chunk's first fencepost
+ * @param info The counts to fill in
+ */
+static void chunk_snapshot(header * fencepost, chunk_info * info) {
+  memset(info, 0, sizeof(*info));
+  info->offset = (char *) fencepost - (char *) base;
+  header * h = get_right_header(fencepost);
+  for (; get_state(h) != FENCEPOST; h = get_right_header(h)) {
+    size_t size = get_size(h);
+    if (get_state(h) == UNALLOCATED) {
+      info->free_blocks++;
+      info->free_bytes += size;
+      if (size > info->largest_free) {
+        info->largest_free = size;
+      }
+    } else {
+      info->allocated_blocks++;
+      info->allocated_bytes += size;
+    }
+  }
+  info->size = (char *) h + ALLOC_HEADER_SIZE - (char *) fencepost;
+}
+
+/**
+ * @brief Helper to write a string as a JSON string literal
+ *
+ * @param out The stream to write to
+ * @param s The string, escaped as JSON requires
+ */
+static void json_string(FILE * out, const char * s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      fprintf(out, "\\%c", *s);
+    } else if ((unsigned char) *s < 0x20) {
+      fprintf(out, "\\u%04x", *s);
+    } else {
+      fputc(*s, out);
+    }
+  }
+  fputc('"', out);
+}
+
+void my_malloc_info(FILE * out) {
+  alloc_stats stats;
+  my_malloc_stats(&stats);
+  malloc_lock_acquire(&chunkLock);
+  size_t chunks = numOsChunks;
+  size_t hard = hardLimit;
+  size_t soft = softLimit;
+  malloc_lock_release(&chunkLock);
+
+  fprintf(out, "{\n  \"version\": 1,\n");
+  fprintf(out, "  \"config\": {\"arena_size\": %zu, \"n_lists\": %d, "
+          "\"n_quick_lists\": %d, \"malloc_alignment\": %d, "
+          "\"size_classes\": \"%s\", \"thread_lines\": %d, "
+          "\"background_interval_ms\": %d},\n",
+          (size_t) ARENA_SIZE, N_LISTS, N_QUICK_LISTS, MALLOC_ALIGNMENT,
+          SIZE_CLASSES == SIZE_CLASSES_GEOMETRIC ? "geometric" : "linear",
+          THREAD_LINES, BACKGROUND_INTERVAL_MS);
+  fprintf(out, "  \"heap\": {\"heap_bytes\": %zu, \"hard_limit\": %zu, "
+          "\"soft_limit\": %zu, \"lock_acquisitions\": %zu, "
+          "\"lock_contended\": %zu, \"lock_wait_cycles\": %llu, "
+          "\"verify_passes\": %zu},\n",
+          stats.heap_bytes, hard, soft, stats.lock_acquisitions,
+          stats.lock_contended, (unsigned long long) stats.lock_wait_cycles,
+          stats.verify_passes);
+
+  // Each chunk and each list is counted under its own lock, which is
+  // released before anything is written
+  fprintf(out, "  \"arenas\": [{\n    \"chunks\": [");
+  for (size_t i = 0; i < chunks; i++) {
+    chunk_info info;
+    malloc_lock_acquire(&tagLock);
+    chunk_snapshot(osChunkList[i], &info);
+    malloc_lock_release(&tagLock);
+    fprintf(out, "%s\n      {\"offset\": %zu, \"size\": %zu, "
+            "\"allocated_blocks\": %zu, \"allocated_bytes\": %zu, "
+            "\"free_blocks\": %zu, \"free_bytes\": %zu, \"largest_free\": %zu}",
+            i ? "," : "", info.offset, info.size, info.allocated_blocks,
+            info.allocated_bytes, info.free_blocks, info.free_bytes,
+            info.largest_free);
+  }
+  fprintf(out, "\n    ],\n    \"size_classes\": [");
+  bool first = true;
+  for (int i = 1; i < N_LISTS; i++) {
+    size_t blocks = 0, bytes = 0;
+    malloc_lock * l = list_lock(i);
+    malloc_lock_acquire(l);
+    header * freelist = &freelistSentinels[i];
+    for (header * h = freelist->next; h != freelist; h = h->next) {
+      blocks++;
+      bytes += get_size(h);
+    }
+    malloc_lock_release(l);
+    if (blocks) {
+      fprintf(out, "%s\n      {\"index\": %d, \"min_size\": %zu, "
+              "\"free_blocks\": %zu, \"free_bytes\": %zu}",
+              first ? "" : ",", i, class_size(i), blocks, bytes);
+      first = false;
+    }
+  }
+  fprintf(out, "\n    ],\n    \"quick_lists\": [");
+#if N_QUICK_LISTS > 0
+  first = true;
+  for (int i = 1; i <= N_QUICK_LISTS && i < N_LISTS - 1; i++) {
+    size_t blocks = 0, bytes = 0;
+    malloc_lock * l = list_lock(i);
+    malloc_lock_acquire(l);
+    for (header * h = quickLists[i]; h; h = h->next) {
+      blocks++;
+      bytes += get_size(h);
+    }
+    malloc_lock_release(l);
+    if (blocks) {
+      fprintf(out, "%s\n      {\"index\": %d, \"blocks\": %zu, \"bytes\": %zu}",
+              first ? "" : ",", i, blocks, bytes);
+      first = false;
+    }
+  }
+#endif
+  size_t pending = 0;
+#if BACKGROUND_INTERVAL_MS > 0
+  pending = __atomic_load_n(&pendingBytes, __ATOMIC_RELAXED);
+#endif
+  fprintf(out, "\n    ],\n    \"pending_free_bytes\": %zu\n  }],\n", pending);
+
+  // The threads are walked again for each one so that no lock is held while
+  // its caches are written
+  fprintf(out, "  \"thread_caches\": {\n    \"line_spans\": [");
+#if THREAD_LINES
+  for (size_t n = 0; ; n++) {
+    size_t used[LINE_CLASSES + 1];
+    malloc_lock_acquire(&threadCacheLock);
+    thread_cache * t = threadCaches;
+    for (size_t i = 0; t && i < n; i++) {
+      t = t->next;
+    }
+    bool calling = t == &threadCache;
+    for (int cls = 1; t && cls <= LINE_CLASSES; cls++) {
+      line_span * span = t->spans[cls];
+      used[cls] = SIZE_MAX;
+      if (span) {
+        malloc_lock_acquire(&span->lock);
+        used[cls] = span->used;
+        malloc_lock_release(&span->lock);
+      }
+    }
+    malloc_lock_release(&threadCacheLock);
+    if (!t) {
+      break;
+    }
+
+    fprintf(out, "%s\n      {\"calling\": %s, \"spans\": [", n ? "," : "",
+            calling ? "true" : "false");
+    first = true;
+    for (int cls = 1; cls <= LINE_CLASSES; cls++) {
+      if (used[cls] == SIZE_MAX) {
+        continue;
+      }
+      size_t slot = ALLOC_HEADER_SIZE + (size_t) cls * 16;
+      fprintf(out, "%s\n        {\"object_size\": %d, \"used\": %zu, "
+              "\"capacity\": %zu}", first ? "" : ",", cls * 16, used[cls],
+              (THREAD_SPAN_SIZE - LINE_SPAN_HEADER) / slot);
+      first = false;
+    }
+    fprintf(out, "\n      ]}");
+  }
+#endif
+  fprintf(out, "\n    ],\n    \"pool_magazines\": [");
+  // Pools are a separate module, they are reported only if linked in
+  if (my_pool_magazines_info) {
+    my_pool_magazines_info(out);
+  }
+  fprintf(out, "\n    ]\n  },\n");
+
+  fprintf(out, "  \"tags\": [");
+  first = true;
+  for (unsigned tag = 1; tag < MAX_TAGS; tag++) {
+    tag_stats t;
+    my_malloc_tag_stats(tag, &t);
+    if (!t.name && !t.total_allocations) {
+      continue;
+    }
+    fprintf(out, "%s\n    {\"tag\": %u, \"name\": ", first ? "" : ",", tag);
+    if (t.name) {
+      json_string(out, t.name);
+    } else {
+      fprintf(out, "null");
+    }
+    fprintf(out, ", \"live_bytes\": %zu, \"live_allocations\": %zu, "
+            "\"total_allocations\": %zu}",
+            t.live_bytes, t.live_allocations, t.total_allocations);
+    first = false;
+  }
+  fprintf(out, "\n  ],\n");
+
+  malloc_lock_acquire(&handleLock);
+  size_t handles = numHandles;
+  malloc_lock_release(&handleLock);
+  fprintf(out, "  \"handles\": {\"entries_used\": %zu}\n}\n", handles);
+  fflush(out);
+}
+
+bool my_malloc_set_limit(size_t hard, size_t soft, my_malloc_limit_callback callback) {
+  if (hard && soft > hard) {
+    errno = EINVAL;
+    return false;
+  }
+  malloc_lock_acquire(&chunkLock);
+  hardLimit = hard;
+  softLimit = soft;
+  limitCallback = callback;
+  malloc_lock_release(&chunkLock);
+  return true;
+}
+
+size_t my_malloc_trim() {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t released = 0;
+  // Blocks in the exact size lists are allocated without the tag lock, but
+  // none of them are large enough to hold a whole page
+  malloc_lock_acquire(&tagLock);
+  for (int i = EXACT_LISTS; i < N_LISTS; i++) {
+    malloc_lock * l = list_lock(i);
+    malloc_lock_acquire(l);
+    header * freelist = &freelistSentinels[i];
+    for (header * h = freelist->next; h != freelist; h = h->next) {
+      released += purge_block(h, page);
+    }
+    malloc_lock_release(l);
+  }
+  malloc_lock_release(&tagLock);
+  return released;
+}
+
+my_handle my_halloc(size_t size) {
+  // Leave room for the handle in the last word of the block
+  size_t padded;
+  if (size == 0) {
+    return NULL;
+  }
+  if (__builtin_add_overflow(size, sizeof(my_handle), &padded)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  void * p = allocate_object(padded);
+  if (!p) {
+    return NULL;
+  }
+  header * h = ptr_to_header(p);
+
+  malloc_lock_acquire(&handleLock);
+  my_handle handle = freeHandles;
+  if (handle) {
+    freeHandles = handle->ptr;
+  } else if (numHandles < MAX_HANDLES) {
+    handle = &handleTable[numHandles++];
+  }
+  if (handle) {
+    handle->ptr = h->data;
+    handle->pins = 0;
+    memcpy((char *) h + get_size(h) - sizeof(handle), &handle, sizeof(handle));
+  }
+  malloc_lock_release(&handleLock);
+
+  if (!handle) {
+    deallocate_object(h->data);
+    errno = ENOMEM;
+  }
+  return handle;
+}
+
+void my_hfree(my_handle handle) {
+  if (!handle) {
+    return;
+  }
+  malloc_lock_acquire(&handleLock);
+  void * p = handle->ptr;
+  // The block can no longer be moved once its handle is unused
+  handle->ptr = freeHandles;
+  freeHandles = handle;
+  malloc_lock_release(&handleLock);
+  deallocate_object(p);
+}
+
+void * my_hpin(my_handle handle) {
+  malloc_lock_acquire(&handleLock);
+  handle->pins++;
+  void * p = handle->ptr;
+  malloc_lock_release(&handleLock);
+  return p;
+}
+
+void my_hunpin(my_handle handle) {
+  malloc_lock_acquire(&handleLock);
+  handle->pins--;
+  malloc_lock_release(&handleLock);
+}
+
+size_t my_compact() {
+  size_t moved = 0;
+  malloc_lock_acquire(&handleLock);
+  malloc_lock_acquire(&chunkLock);
+  malloc_lock_acquire(&tagLock);
+#if N_QUICK_LISTS > 0
+  // Blocks on the quick lists look allocated and would stop blocks moving
+  consolidate_quick_lists();
+#endif
+#if BACKGROUND_INTERVAL_MS > 0
+  drain_pending_frees();
+#endif
+  for (int i = 0; i < N_LIST_LOCKS; i++) {
+    malloc_lock_acquire(&listLocks[i].lock);
+  }
+
+  for (size_t i = 0; i < numOsChunks; i++) {
+    moved += compact_run(osChunkList[i]);
+  }
+  // Block boundaries have moved, restart verification of the current chunk
+  verifyCursor.block = NULL;
+
+  for (int i = N_LIST_LOCKS - 1; i >= 0; i--) {
+    malloc_lock_release(&listLocks[i].lock);
+  }
+  malloc_lock_release(&tagLock);
+  malloc_lock_release(&chunkLock);
+  malloc_lock_release(&handleLock);
+
+  if (moved > 0) {
+    my_malloc_trim();
+  }
+  return moved;
+}
+
+bool verify() {
+  return verify_freelist() && verify_tags();
+}
+
+bool my_verify_step(size_t budget) {
+  bool valid = true;
+  malloc_lock_acquire(&tagLock);
+  // Every step, including moving between chunks, uses up one unit of budget
+  for (; budget > 0 && numOsChunks > 0; budget--) {
+    verify_cursor * c = &verifyCursor;
+    if (!c->block) {
+      header * fp = osChunkList[c->chunk];
+      if (get_state(fp) != FENCEPOST) {
+        fprintf(stderr, "Invalid fencepost\n");
+        print_object(fp);
+        valid = false;
+        break;
+      }
+      c->block = get_right_header(fp);
+    } else if (get_state(c->block) == FENCEPOST) {
+      // Only the last fencepost of a run ends a chunk, the run's end may
+      // already include a chunk that is still being merged in
+      heap_run * run = page_map_get(&pageMap, c->block);
+      if (c->block != lastFencePost &&
+          (!run || (char *) c->block + ALLOC_HEADER_SIZE != run->end)) {
+        fprintf(stderr, "Invalid fencepost\n");
+        print_object(c->block);
+        valid = false;
+        break;
+      }
+      c->block = NULL;
+      if (++c->chunk == numOsChunks) {
+        c->chunk = 0;
+        __atomic_store_n(&c->passes, c->passes + 1, __ATOMIC_RELAXED);
+      }
+    } else if (verify_block(c->block)) {
+      c->block = get_right_header(c->block);
+    } else {
+      valid = false;
+      break;
+    }
+  }
+  malloc_lock_release(&tagLock);
+  return valid;
 }
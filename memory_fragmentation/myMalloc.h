@@ -2,8 +2,14 @@
 #define MY_MALLOC_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define RELATIVE_POINTERS true
 
 #ifndef ARENA_SIZE
@@ -11,10 +17,196 @@
 #define ARENA_SIZE 4096
 #endif
 
+/* Size class layouts selected at compile time with -DSIZE_CLASSES=... */
+#define SIZE_CLASSES_LINEAR 1
+#define SIZE_CLASSES_GEOMETRIC 2
+
+#ifndef SIZE_CLASSES
+// If not specified at compile time every freelist but the last holds blocks
+// of a single size, 8 bytes apart. Otherwise blocks of at least
+// 1 << GEOMETRIC_MIN_SHIFT bytes are split into four lists per power of two
+// up to 1 << GEOMETRIC_MAX_SHIFT bytes.
+#define SIZE_CLASSES SIZE_CLASSES_LINEAR
+#endif
+
+/* Range of block sizes with geometric size classes */
+#define GEOMETRIC_MIN_SHIFT 9
+#ifndef GEOMETRIC_MAX_SHIFT
+#define GEOMETRIC_MAX_SHIFT 21
+#endif
+
+/* Number of freelists 8 bytes apart below the geometric classes, matching
+ * the index of a block of 1 << GEOMETRIC_MIN_SHIFT bytes with a 16 byte
+ * header */
+#define LINEAR_LISTS (((1 << GEOMETRIC_MIN_SHIFT) - 16) / 8 - 1)
+
 #ifndef N_LISTS
 // If not specified at compile time use the default number of free lists
+#if SIZE_CLASSES == SIZE_CLASSES_GEOMETRIC
+#define N_LISTS (LINEAR_LISTS + 4 * (GEOMETRIC_MAX_SHIFT - GEOMETRIC_MIN_SHIFT) + 1)
+#else
 #define N_LISTS 59
 #endif
+#endif
+
+#ifndef LISTS_PER_LOCK
+// If not specified at compile time give every free list its own lock
+#define LISTS_PER_LOCK 1
+#endif
+
+/* Number of locks needed to cover all of the free lists */
+#define N_LIST_LOCKS ((N_LISTS + LISTS_PER_LOCK - 1) / LISTS_PER_LOCK)
+
+#ifndef N_QUICK_LISTS
+// If not specified at compile time freed blocks are always coalesced.
+// Otherwise blocks in the first N_QUICK_LISTS size classes are kept on quick
+// lists when freed and only coalesced in bulk.
+#define N_QUICK_LISTS 0
+#endif
+
+#ifndef QUICK_LIST_BUDGET
+// Number of bytes the quick lists may hold before they are consolidated
+#define QUICK_LIST_BUDGET 65536
+#endif
+
+/* Policies for choosing a block from the last freelist, which holds blocks of
+ * every large size, selected at compile time with -DFIT_POLICY=... */
+#define FIT_FIRST 1
+#define FIT_BEST 2
+#define FIT_NEXT 3
+#define FIT_GOOD 4
+
+#ifndef FIT_POLICY
+// If not specified at compile time take the first block that fits. FIT_BEST
+// takes the smallest block that fits, FIT_NEXT resumes searching where the
+// previous search stopped and FIT_GOOD takes the smallest of the first
+// FIT_SEARCH_DEPTH blocks that fit.
+#define FIT_POLICY FIT_FIRST
+#endif
+
+#ifndef FIT_SEARCH_DEPTH
+// Number of fitting blocks compared by FIT_GOOD
+#define FIT_SEARCH_DEPTH 8
+#endif
+
+#ifndef ARENA_MMAP
+// If not specified at compile time chunks are requested with sbrk. Otherwise
+// chunks are carved from huge page aligned regions reserved with mmap.
+#define ARENA_MMAP 0
+#endif
+
+#ifndef ARENA_HUGEPAGES
+// If not specified at compile time regions reserved with mmap are advised to
+// be backed by transparent huge pages, set to 0 to advise against it
+#define ARENA_HUGEPAGES 1
+#endif
+
+#ifndef ARENA_RESERVE_SIZE
+// Size of each region reserved with mmap, a multiple of HUGE_PAGE_SIZE.
+// Larger requests reserve a region of their own.
+#define ARENA_RESERVE_SIZE ((size_t) 64 << 20)
+#endif
+
+/* Size and alignment of a transparent huge page */
+#define HUGE_PAGE_SIZE ((size_t) 2 << 20)
+
+#ifndef MALLOC_FORK_RESET
+// If not specified at compile time a forked child keeps using the inherited
+// heap. Otherwise the child starts with a fresh arena and never writes to the
+// inherited one, so it copies no heap pages on write.
+#define MALLOC_FORK_RESET 0
+#endif
+
+#ifndef ZERO_ON_FREE
+// Freed memory is zeroed unless forked children should avoid touching pages
+#define ZERO_ON_FREE (!MALLOC_FORK_RESET)
+#endif
+
+#ifndef GUARD_SAMPLE_RATE
+// If not specified at compile time no allocation is guarded. Otherwise about
+// one in GUARD_SAMPLE_RATE allocations of at most a page is placed at the end
+// of a page followed by an inaccessible guard page and the page is made
+// inaccessible when freed, so overflows and uses after free fault at once.
+#define GUARD_SAMPLE_RATE 0
+#endif
+
+#ifndef GUARD_SLOTS
+// Number of sampled allocations that can be live at the same time
+#define GUARD_SLOTS 16
+#endif
+
+/* Value of the padding after a sampled allocation, checked when it is freed */
+#define GUARD_CANARY 0xab
+
+#ifndef VERIFY_STEP_BUDGET
+// Number of blocks checked by each incremental verification the allocator
+// runs on its own
+#define VERIFY_STEP_BUDGET 64
+#endif
+
+#ifndef VERIFY_EVERY_N_FREES
+// If not specified at compile time the heap is only verified on request.
+// Otherwise every N frees a thread verifies the next VERIFY_STEP_BUDGET
+// blocks and stops the program if the heap is corrupt.
+#define VERIFY_EVERY_N_FREES 0
+#endif
+
+#ifndef VERIFY_INTERVAL_MS
+// If not specified at compile time no thread is started. Otherwise a
+// background thread verifies the next VERIFY_STEP_BUDGET blocks every
+// VERIFY_INTERVAL_MS milliseconds. Forked children do not inherit the thread.
+#define VERIFY_INTERVAL_MS 0
+#endif
+
+#ifndef BACKGROUND_INTERVAL_MS
+// If not specified at compile time freed blocks are coalesced by the thread
+// freeing them. Otherwise my_free only pushes blocks onto a pending list and
+// a background thread coalesces them every BACKGROUND_INTERVAL_MS
+// milliseconds.
+#define BACKGROUND_INTERVAL_MS 0
+#endif
+
+#ifndef PURGE_DECAY_MS
+// Time a free block must go without taking in a newly freed block before the
+// background thread returns the pages inside it to the OS
+#define PURGE_DECAY_MS 1000
+#endif
+
+#ifndef PENDING_FREE_BUDGET
+// Bytes the pending list may hold before the freeing thread coalesces them
+// itself, which also keeps forked children, which do not inherit the
+// background thread, from growing the heap
+#define PENDING_FREE_BUDGET (1 << 20)
+#endif
+
+/* Size of a cache line, my_malloc_isolated rounds and aligns to it */
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+#ifndef THREAD_LINES
+// If not specified at compile time blocks allocated by different threads may
+// share a cache line. Otherwise requests of at most THREAD_LINES_MAX bytes are
+// carved from cache line aligned spans owned by the allocating thread, so
+// small objects of two threads never share a line.
+#define THREAD_LINES 0
+#endif
+
+#ifndef THREAD_LINES_MAX
+// Largest request carved from a thread's span, a multiple of 16
+#define THREAD_LINES_MAX 256
+#endif
+
+#ifndef THREAD_SPAN_SIZE
+// Size of each span allocated for a thread, a multiple of CACHE_LINE_SIZE
+#define THREAD_SPAN_SIZE 4096
+#endif
+
+#ifndef ZERO_MADVISE_THRESHOLD
+// Blocks at least this large are zeroed by handing their pages back to the
+// OS rather than writing to every byte
+#define ZERO_MADVISE_THRESHOLD (1 << 20)
+#endif
 
 /* Size of the header for an allocated block
  *
@@ -26,6 +218,13 @@
 /* The minimum size request the allocator will service */
 #define MIN_ALLOCATION 8
 
+#ifndef MALLOC_ALIGNMENT
+// Alignment of every block returned by my_malloc, 8 or 16. C++ programs need
+// 16 as operator new must return memory aligned to
+// __STDCPP_DEFAULT_NEW_ALIGNMENT__.
+#define MALLOC_ALIGNMENT 8
+#endif
+
 /**
  * @brief enum representing the allocation state of a block
  *
@@ -36,6 +235,8 @@ enum state {
   UNALLOCATED = 0,
   ALLOCATED = 1,
   FENCEPOST = 2,
+  // An object carved from a thread's span with THREAD_LINES
+  SPAN_OBJECT = 3,
 };
 
 /*
@@ -85,8 +286,12 @@ typedef struct header {
 // Therefore we use the 3 lowest bits to store the state of the object.
 // This is going to save 8 bytes in all objects.
 
+// The bit above the state marks an allocated block from my_malloc_tagged,
+// whose last word holds its tag
+#define TAGGED_BIT 0x4
+
 static inline size_t get_size(header * h) {
-	return h->size_state & ~0x3;
+	return h->size_state & ~0x7;
 }
 
 static inline void set_size(header * h, size_t size) {
@@ -107,15 +312,118 @@ static inline void set_size_and_state(header * h, size_t size, enum state s) {
 
 #define MAX_OS_CHUNKS 1024
 
+#ifndef MAX_HANDLES
+// Number of handles from my_halloc that can be live at the same time
+#define MAX_HANDLES 65536
+#endif
+
+#ifndef MAX_TAGS
+// Number of allocation tags, tag 0 is untagged memory
+#define MAX_TAGS 64
+#endif
+
+/*
+ * Allocator statistics filled in by my_malloc_stats
+ *
+ * size_t lock_acquisitions Number of times any allocator lock was taken
+ * size_t lock_contended Acquisitions that found the lock already held
+ * uint64_t lock_wait_cycles Cycles spent waiting for held locks
+ * size_t heap_bytes Size of the pages holding the heap, from the page map
+ * size_t verify_passes Complete passes over the heap made by my_verify_step
+ */
+typedef struct alloc_stats {
+  size_t lock_acquisitions;
+  size_t lock_contended;
+  uint64_t lock_wait_cycles;
+  size_t heap_bytes;
+  size_t verify_passes;
+} alloc_stats;
+
 // Malloc interface
 void * my_malloc(size_t size);
 void * my_calloc(size_t nmemb, size_t size);
 void * my_realloc(void * ptr, size_t size);
 void my_free(void * p);
+void * my_aligned_alloc(size_t alignment, size_t size);
+void * my_malloc_isolated(size_t size);
+
+// Number of bytes of a block that may be used, at least the size requested
+size_t my_malloc_usable_size(void * p);
+
+// Allocate at least size bytes, setting actual to the usable size so callers
+// can grow into the slack without reallocating
+void * my_malloc_at_least(size_t size, size_t * actual);
+
+// Allocator statistics
+void my_malloc_stats(alloc_stats * stats);
+
+/*
+ * Memory held by one allocation tag, filled in by my_malloc_tag_stats
+ *
+ * const char * name The name given with my_malloc_tag_name or NULL
+ * size_t live_bytes Usable bytes of the tag's allocations not yet freed
+ * size_t live_allocations Number of the tag's allocations not yet freed
+ * size_t total_allocations Number of allocations ever made with the tag
+ */
+typedef struct tag_stats {
+  const char * name;
+  size_t live_bytes;
+  size_t live_allocations;
+  size_t total_allocations;
+} tag_stats;
+
+// Allocate memory accounted to a tag from 1 to MAX_TAGS - 1, so the memory
+// each part of a program holds can be told apart. Tag 0 is plain my_malloc.
+void * my_malloc_tagged(size_t size, unsigned tag);
+
+// Name a tag for tag_stats_print, the string must outlive its use
+bool my_malloc_tag_name(unsigned tag, const char * name);
+
+// Per tag statistics, returns false for a tag out of range
+bool my_malloc_tag_stats(unsigned tag, tag_stats * stats);
+
+// Write the state of the allocator as one JSON document, safe to call
+// periodically from a running program as no lock is held for long. The
+// thread caches of every live thread are included, pool magazines only when
+// pool.c is linked in.
+void my_malloc_info(FILE * out);
+
+/*
+ * Called when the heap grows past the soft limit with the size of the heap
+ * and the limit. No allocator lock is held so it may free (or allocate)
+ * memory, allocations it makes do not call it again.
+ */
+typedef void (*my_malloc_limit_callback)(size_t heap_bytes, size_t soft_limit);
+
+// Stop the heap growing past hard bytes and call callback and trim the heap
+// whenever it grows past soft bytes, a limit of 0 is no limit
+bool my_malloc_set_limit(size_t hard, size_t soft, my_malloc_limit_callback callback);
+
+// Return the pages inside free blocks to the OS, returns the bytes released
+size_t my_malloc_trim();
+
+/*
+ * A handle to a block that my_compact may move. The block's address is only
+ * stable between my_hpin and the matching my_hunpin.
+ */
+typedef struct my_handle_entry * my_handle;
+
+// Relocatable allocations
+my_handle my_halloc(size_t size);
+void my_hfree(my_handle handle);
+void * my_hpin(my_handle handle);
+void my_hunpin(my_handle handle);
+
+// Slide unpinned handle blocks towards the start of their chunk so the free
+// space between them coalesces and can be trimmed, returns the blocks moved
+size_t my_compact();
 
 // Debug list verifitcation
 bool verify();
 
+// Verify at most budget blocks, continuing from where the last call stopped
+bool my_verify_step(size_t budget);
+
 // Helper to find a block's right neighbor
 header * get_right_header(header * h);
 
@@ -130,5 +438,12 @@ extern header freelistSentinels[];
 extern char freelist_bitmap[];
 extern header * osChunkList[];
 extern size_t numOsChunks;
+#if N_QUICK_LISTS > 0
+extern header * quickLists[];
+#endif
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // MY_MALLOC_H
@@ -0,0 +1,165 @@
+#ifndef MY_MALLOC_HH
+#define MY_MALLOC_HH
+
+/*
+ * C++ adaptors over the allocator and the pools
+ *
+ * MyMallocResource and MyPoolResource are std::pmr::memory_resource
+ * subclasses for use with the std::pmr containers, and MyAllocator is a
+ * standard allocator for the usual containers. Linking myNewDelete.cc also
+ * sends every new and delete expression to my_malloc.
+ *
+ * Build the allocator with -DMALLOC_ALIGNMENT=16 so that allocations with the
+ * default alignment of operator new take the fast path of my_aligned_alloc.
+ */
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+#include "myMalloc.h"
+#include "pool.h"
+
+/**
+ * @brief Allocate from my_malloc, throwing std::bad_alloc on failure
+ *
+ * @param bytes The number of bytes needed, a request for 0 bytes returns a
+ *        unique pointer as C++ requires
+ * @param alignment The alignment needed, a power of two
+ */
+inline void * my_malloc_or_throw(std::size_t bytes, std::size_t alignment) {
+  void * p = my_aligned_alloc(alignment, bytes ? bytes : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+/*
+ * Memory resource backed by my_malloc and my_free. Every instance allocates
+ * from the same heap so any two compare equal.
+ */
+class MyMallocResource : public std::pmr::memory_resource {
+protected:
+  void * do_allocate(std::size_t bytes, std::size_t alignment) override {
+    return my_malloc_or_throw(bytes, alignment);
+  }
+
+  void do_deallocate(void * p, std::size_t, std::size_t) override {
+    my_free(p);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override {
+    return dynamic_cast<const MyMallocResource *>(&other) != nullptr;
+  }
+};
+
+/**
+ * @brief The shared MyMallocResource. It is never destroyed so containers
+ *        with static storage can still free into it at exit.
+ */
+inline MyMallocResource * my_malloc_resource() {
+  alignas(MyMallocResource) static unsigned char storage[sizeof(MyMallocResource)];
+  static MyMallocResource * resource = new (storage) MyMallocResource();
+  return resource;
+}
+
+/*
+ * Memory resource serving requests that fit one object of a pool from the
+ * pool and everything else from an upstream resource, suited to node based
+ * containers such as std::pmr::list and std::pmr::map.
+ *
+ * Pools live for the lifetime of the process, so the pool is not released
+ * when the resource is destroyed and a program may only create MAX_POOLS of
+ * them.
+ */
+class MyPoolResource : public std::pmr::memory_resource {
+public:
+  /**
+   * @param obj_size The size of the objects kept in the pool
+   * @param align The alignment of the objects kept in the pool
+   * @param upstream The resource used for any other request
+   */
+  MyPoolResource(std::size_t obj_size, std::size_t align = alignof(std::max_align_t),
+                 std::pmr::memory_resource * upstream = my_malloc_resource())
+      : pool_(my_pool_create(obj_size, align)), objSize_(obj_size),
+        align_(align), upstream_(upstream) {
+    if (!pool_) {
+      throw std::bad_alloc();
+    }
+  }
+
+  MyPoolResource(const MyPoolResource &) = delete;
+  MyPoolResource & operator=(const MyPoolResource &) = delete;
+
+protected:
+  void * do_allocate(std::size_t bytes, std::size_t alignment) override {
+    if (!fits(bytes, alignment)) {
+      return upstream_->allocate(bytes, alignment);
+    }
+    void * p = my_pool_alloc(pool_);
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return p;
+  }
+
+  void do_deallocate(void * p, std::size_t bytes, std::size_t alignment) override {
+    if (!fits(bytes, alignment)) {
+      upstream_->deallocate(p, bytes, alignment);
+      return;
+    }
+    my_pool_free(pool_, p);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override {
+    return this == &other;
+  }
+
+private:
+  bool fits(std::size_t bytes, std::size_t alignment) const {
+    return bytes <= objSize_ && alignment <= align_;
+  }
+
+  my_pool * pool_;
+  std::size_t objSize_;
+  std::size_t align_;
+  std::pmr::memory_resource * upstream_;
+};
+
+/*
+ * Standard allocator backed by my_malloc and my_free, stateless so any two
+ * compare equal
+ */
+template <class T>
+struct MyAllocator {
+  using value_type = T;
+
+  MyAllocator() noexcept = default;
+
+  template <class U>
+  MyAllocator(const MyAllocator<U> &) noexcept {}
+
+  T * allocate(std::size_t n) {
+    if (n > static_cast<std::size_t>(-1) / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    return static_cast<T *>(my_malloc_or_throw(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T * p, std::size_t) noexcept {
+    my_free(p);
+  }
+};
+
+template <class T, class U>
+bool operator==(const MyAllocator<T> &, const MyAllocator<U> &) noexcept {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const MyAllocator<T> &, const MyAllocator<U> &) noexcept {
+  return false;
+}
+
+#endif // MY_MALLOC_HH
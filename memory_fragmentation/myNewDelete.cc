@@ -0,0 +1,135 @@
+/*
+ * Replacements for the global operator new and delete that allocate from
+ * my_malloc. Linking this file into a program is enough to replace them.
+ */
+
+#include <cstddef>
+#include <new>
+
+#include "myMalloc.h"
+
+/**
+ * @brief Allocate as operator new must, calling the new handler until the
+ *        allocation succeeds or no handler is installed
+ *
+ * @param size The number of bytes needed
+ * @param alignment The alignment needed
+ *
+ * @return The allocation or nullptr if it failed and there was no handler
+ */
+static void * allocate(std::size_t size, std::size_t alignment) {
+  if (size == 0) {
+    size = 1;
+  }
+  for (;;) {
+    void * p = my_aligned_alloc(alignment, size);
+    if (p) {
+      return p;
+    }
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) {
+      return nullptr;
+    }
+    handler();
+  }
+}
+
+static void * allocate_or_throw(std::size_t size, std::size_t alignment) {
+  void * p = allocate(size, alignment);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+static void * allocate_nothrow(std::size_t size, std::size_t alignment) noexcept {
+  try {
+    return allocate(size, alignment);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void * operator new(std::size_t size) {
+  return allocate_or_throw(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void * operator new[](std::size_t size) {
+  return allocate_or_throw(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void * operator new(std::size_t size, std::align_val_t align) {
+  return allocate_or_throw(size, static_cast<std::size_t>(align));
+}
+
+void * operator new[](std::size_t size, std::align_val_t align) {
+  return allocate_or_throw(size, static_cast<std::size_t>(align));
+}
+
+void * operator new(std::size_t size, std::align_val_t align,
+                    const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void * operator new[](std::size_t size, std::align_val_t align,
+                      const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, static_cast<std::size_t>(align));
+}
+
+// Every block records its own size, so the sized and aligned forms of delete
+// free the same way as the plain one
+void operator delete(void * p) noexcept {
+  my_free(p);
+}
+
+void operator delete[](void * p) noexcept {
+  my_free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept {
+  my_free(p);
+}
+
+void operator delete[](void * p, std::size_t) noexcept {
+  my_free(p);
+}
+
+void operator delete(void * p, const std::nothrow_t &) noexcept {
+  my_free(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t &) noexcept {
+  my_free(p);
+}
+
+void operator delete(void * p, std::align_val_t) noexcept {
+  my_free(p);
+}
+
+void operator delete[](void * p, std::align_val_t) noexcept {
+  my_free(p);
+}
+
+void operator delete(void * p, std::size_t, std::align_val_t) noexcept {
+  my_free(p);
+}
+
+void operator delete[](void * p, std::size_t, std::align_val_t) noexcept {
+  my_free(p);
+}
+
+void operator delete(void * p, std::align_val_t, const std::nothrow_t &) noexcept {
+  my_free(p);
+}
+
+void operator delete[](void * p, std::align_val_t, const std::nothrow_t &) noexcept {
+  my_free(p);
+}
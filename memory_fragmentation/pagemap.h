@@ -0,0 +1,170 @@
+#ifndef PAGEMAP_H
+#define PAGEMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/*
+ * A three level radix tree mapping the page number of an address to a
+ * descriptor for the memory containing it
+ *
+ * The page number is split into a root, middle and leaf index. Interior nodes
+ * are allocated with mmap the first time a page under them is set and are
+ * never freed, so lookups need no lock: a reader either sees a node fully
+ * initialized or sees NULL and reports the page as unmapped.
+ */
+
+#ifndef PAGEMAP_PAGE_SHIFT
+// Granularity of the map, independent of the OS page size
+#define PAGEMAP_PAGE_SHIFT 12
+#endif
+
+#ifndef PAGEMAP_ADDRESS_BITS
+// Number of significant bits in a user space address
+#if UINTPTR_MAX > 0xffffffff
+#define PAGEMAP_ADDRESS_BITS 48
+#else
+#define PAGEMAP_ADDRESS_BITS 32
+#endif
+#endif
+
+#define PAGEMAP_BITS (PAGEMAP_ADDRESS_BITS - PAGEMAP_PAGE_SHIFT)
+#define PAGEMAP_LEAF_BITS (PAGEMAP_BITS / 3)
+#define PAGEMAP_MID_BITS (PAGEMAP_BITS / 3)
+#define PAGEMAP_ROOT_BITS (PAGEMAP_BITS - PAGEMAP_LEAF_BITS - PAGEMAP_MID_BITS)
+
+#define PAGEMAP_LEAF_SIZE ((size_t) 1 << PAGEMAP_LEAF_BITS)
+#define PAGEMAP_MID_SIZE ((size_t) 1 << PAGEMAP_MID_BITS)
+#define PAGEMAP_ROOT_SIZE ((size_t) 1 << PAGEMAP_ROOT_BITS)
+
+typedef struct page_map_leaf {
+  void * values[PAGEMAP_LEAF_SIZE];
+} page_map_leaf;
+
+typedef struct page_map_mid {
+  page_map_leaf * leaves[PAGEMAP_MID_SIZE];
+} page_map_mid;
+
+/*
+ * FIELDS
+ * page_map_mid * root Interior nodes indexed by the top bits of the page
+ * size_t pages Number of pages with a descriptor
+ */
+typedef struct page_map {
+  page_map_mid * root[PAGEMAP_ROOT_SIZE];
+  size_t pages;
+} page_map;
+
+/**
+ * @brief Split an address into its indices at each level of the map
+ *
+ * @return false if the address is beyond PAGEMAP_ADDRESS_BITS
+ */
+static inline bool page_map_index(const void * p, size_t * root, size_t * mid,
+                                  size_t * leaf) {
+  uintptr_t page = (uintptr_t) p >> PAGEMAP_PAGE_SHIFT;
+  if (page >> PAGEMAP_BITS) {
+    return false;
+  }
+  *leaf = page & (PAGEMAP_LEAF_SIZE - 1);
+  *mid = (page >> PAGEMAP_LEAF_BITS) & (PAGEMAP_MID_SIZE - 1);
+  *root = page >> (PAGEMAP_LEAF_BITS + PAGEMAP_MID_BITS);
+  return true;
+}
+
+/**
+ * @brief Allocate a zeroed node of the tree directly from the OS
+ */
+static inline void * page_map_node(size_t size) {
+  void * mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return mem == MAP_FAILED ? NULL : mem;
+}
+
+/**
+ * @brief Find the descriptor of the memory containing an address, safe to
+ *        call without holding the lock used for updates
+ *
+ * @param map The map to search
+ * @param p Any address
+ *
+ * @return The descriptor for p's page or NULL if the page is not mapped
+ */
+static inline void * page_map_get(page_map * map, const void * p) {
+  size_t r, m, l;
+  if (!page_map_index(p, &r, &m, &l)) {
+    return NULL;
+  }
+  page_map_mid * mid = __atomic_load_n(&map->root[r], __ATOMIC_ACQUIRE);
+  if (!mid) {
+    return NULL;
+  }
+  page_map_leaf * leaf = __atomic_load_n(&mid->leaves[m], __ATOMIC_ACQUIRE);
+  if (!leaf) {
+    return NULL;
+  }
+  return __atomic_load_n(&leaf->values[l], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Set the descriptor of every page overlapping a range, updates must
+ *        be serialized by the caller
+ *
+ * @param map The map to update
+ * @param start The start of the range
+ * @param len The length of the range in bytes
+ * @param value The descriptor, or NULL to remove the range from the map
+ *
+ * @return false if a node of the tree could not be allocated
+ */
+static inline bool page_map_set(page_map * map, const void * start, size_t len,
+                                void * value) {
+  if (len == 0) {
+    return true;
+  }
+
+  uintptr_t page = (uintptr_t) start >> PAGEMAP_PAGE_SHIFT;
+  uintptr_t last = ((uintptr_t) start + len - 1) >> PAGEMAP_PAGE_SHIFT;
+  for (; page <= last; page++) {
+    size_t r, m, l;
+    if (!page_map_index((void *) (page << PAGEMAP_PAGE_SHIFT), &r, &m, &l)) {
+      return false;
+    }
+
+    // Nodes are only created when setting, clearing skips missing subtrees
+    page_map_mid * mid = map->root[r];
+    if (!mid && value) {
+      if (!(mid = page_map_node(sizeof(page_map_mid)))) {
+        return false;
+      }
+      __atomic_store_n(&map->root[r], mid, __ATOMIC_RELEASE);
+    }
+    if (!mid) {
+      continue;
+    }
+
+    page_map_leaf * leaf = mid->leaves[m];
+    if (!leaf && value) {
+      if (!(leaf = page_map_node(sizeof(page_map_leaf)))) {
+        return false;
+      }
+      __atomic_store_n(&mid->leaves[m], leaf, __ATOMIC_RELEASE);
+    }
+    if (!leaf) {
+      continue;
+    }
+
+    // The count is read without the update lock by statistics
+    if (!leaf->values[l] && value) {
+      __atomic_fetch_add(&map->pages, 1, __ATOMIC_RELAXED);
+    } else if (leaf->values[l] && !value) {
+      __atomic_fetch_sub(&map->pages, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&leaf->values[l], value, __ATOMIC_RELEASE);
+  }
+  return true;
+}
+
+#endif // PAGEMAP_H
@@ -0,0 +1,426 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/*
+ * Storage for every pool that has been created. Pools live for the lifetime
+ * of the process, the id of a pool is its index in this array
+ */
+static my_pool pools[MAX_POOLS];
+static int numPools = 0;
+
+/*
+ * Mutex protecting the creation of new pools
+ */
+static pthread_mutex_t poolsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+#if POOL_MAGAZINE_SIZE > 0
+/*
+ * A magazine is a small per-thread stack of free objects from one pool.
+ * Allocations and frees that hit the magazine never take the pool lock.
+ */
+typedef struct magazine {
+  size_t count;
+  void * objects[POOL_MAGAZINE_SIZE];
+} magazine;
+
+static __thread magazine magazines[MAX_POOLS];
+static __thread bool magazinesRegistered;
+
+/*
+ * Key used only for its destructor so that a thread's magazines are returned
+ * to their pools when the thread exits
+ */
+static pthread_key_t magazineKey;
+static pthread_once_t magazineKeyOnce = PTHREAD_ONCE_INIT;
+
+/*
+ * Links the magazines of a thread into the list my_pool_magazines_info
+ * reports
+ *
+ * FIELDS
+ * magazine * magazines The magazines of the thread
+ * struct thread_magazines * next The next thread in the list
+ * struct thread_magazines * prev The previous thread in the list
+ */
+typedef struct thread_magazines {
+  magazine * magazines;
+  struct thread_magazines * next;
+  struct thread_magazines * prev;
+} thread_magazines;
+
+static __thread thread_magazines threadMagazines;
+
+/*
+ * Every thread that registered its magazines and has not exited
+ */
+static thread_magazines * allMagazines;
+static pthread_mutex_t allMagazinesMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+// Helper functions for managing a pool's objects while holding its lock
+static inline size_t round_up(size_t n, size_t align);
+static bool allocate_slab(my_pool * pool);
+static inline void * pool_get_object(my_pool * pool);
+static inline void pool_put_object(my_pool * pool, void * p);
+
+#if POOL_MAGAZINE_SIZE > 0
+// Helper functions for moving objects between a magazine and its pool
+static void refill_magazine(my_pool * pool, magazine * mag);
+static void flush_magazine(my_pool * pool, magazine * mag, size_t n);
+static void release_magazines(void * unused);
+static void create_magazine_key(void);
+static void lock_magazine_list(void);
+static void unlock_magazine_list(void);
+static void reset_magazine_list(void);
+#endif
+
+/**
+ * @brief Helper to round a size up to a power of two alignment
+ *
+ * @param n The size to round
+ * @param align The alignment, must be a power of two
+ *
+ * @return n rounded up to a multiple of align
+ */
+static inline size_t round_up(size_t n, size_t align) {
+  return (n + align - 1) & ~(align - 1);
+}
+
+/**
+ * @brief Request a new slab from the OS and make it the slab objects are
+ *        carved from
+ *
+ * @param pool The pool to grow
+ *
+ * @return true if the slab was allocated
+ */
+static bool allocate_slab(my_pool * pool) {
+  void * mem = mmap(NULL, pool->slab_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    return false;
+  }
+
+  pool_slab * slab = (pool_slab *) mem;
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+  pool->numSlabs++;
+
+  // Objects are carved lazily so a new slab costs no more than the mmap
+  pool->bump = (char *) round_up((uintptr_t) (slab + 1), pool->align);
+  pool->end = (char *) mem + pool->slab_size;
+  return true;
+}
+
+/**
+ * @brief Take one object from a pool, the pool lock must be held
+ *
+ * @param pool The pool to allocate from
+ *
+ * @return A free object or NULL if the OS is out of memory
+ */
+static inline void * pool_get_object(my_pool * pool) {
+  pool_object * obj = pool->freelist;
+  if (obj) {
+    pool->freelist = obj->next;
+    return obj;
+  }
+
+  if (pool->bump + pool->obj_size > pool->end && !allocate_slab(pool)) {
+    return NULL;
+  }
+
+  obj = (pool_object *) pool->bump;
+  pool->bump += pool->obj_size;
+  return obj;
+}
+
+/**
+ * @brief Return one object to a pool, the pool lock must be held
+ *
+ * @param pool The pool owning the object
+ * @param p The object to return
+ */
+static inline void pool_put_object(my_pool * pool, void * p) {
+  pool_object * obj = (pool_object *) p;
+  obj->next = pool->freelist;
+  pool->freelist = obj;
+}
+
+#if POOL_MAGAZINE_SIZE > 0
+/**
+ * @brief Make sure the calling thread's magazines are returned to their pools
+ *        when it exits, before its first object is cached in one
+ */
+static inline void register_magazines() {
+  if (!magazinesRegistered) {
+    // Any non NULL value makes the destructor run when the thread exits
+    pthread_setspecific(magazineKey, magazines);
+    magazinesRegistered = true;
+
+    threadMagazines.magazines = magazines;
+    pthread_mutex_lock(&allMagazinesMutex);
+    threadMagazines.prev = NULL;
+    threadMagazines.next = allMagazines;
+    if (allMagazines) {
+      allMagazines->prev = &threadMagazines;
+    }
+    allMagazines = &threadMagazines;
+    pthread_mutex_unlock(&allMagazinesMutex);
+  }
+}
+
+/**
+ * @brief Fill half of an empty magazine from its pool
+ *
+ * @param pool The pool to take objects from
+ * @param mag The calling thread's magazine for pool
+ */
+static void refill_magazine(my_pool * pool, magazine * mag) {
+  register_magazines();
+
+  pthread_mutex_lock(&pool->lock);
+  while (mag->count < (POOL_MAGAZINE_SIZE + 1) / 2) {
+    void * obj = pool_get_object(pool);
+    if (!obj) {
+      break;
+    }
+    mag->objects[mag->count++] = obj;
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Return the top n objects of a magazine to its pool
+ *
+ * @param pool The pool owning the objects
+ * @param mag The magazine to drain
+ * @param n The number of objects to return
+ */
+static void flush_magazine(my_pool * pool, magazine * mag, size_t n) {
+  pthread_mutex_lock(&pool->lock);
+  for (; n > 0; n--) {
+    pool_put_object(pool, mag->objects[--mag->count]);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Thread exit destructor returning every cached object to its pool
+ *
+ * @param unused The value registered with the key
+ */
+static void release_magazines(void * unused) {
+  (void) unused;
+  pthread_mutex_lock(&allMagazinesMutex);
+  if (threadMagazines.prev) {
+    threadMagazines.prev->next = threadMagazines.next;
+  } else if (allMagazines == &threadMagazines) {
+    allMagazines = threadMagazines.next;
+  }
+  if (threadMagazines.next) {
+    threadMagazines.next->prev = threadMagazines.prev;
+  }
+  threadMagazines.next = threadMagazines.prev = NULL;
+  pthread_mutex_unlock(&allMagazinesMutex);
+
+  for (int i = 0; i < MAX_POOLS; i++) {
+    if (magazines[i].count) {
+      flush_magazine(&pools[i], &magazines[i], magazines[i].count);
+    }
+  }
+}
+
+static void create_magazine_key(void) {
+  pthread_key_create(&magazineKey, release_magazines);
+  pthread_atfork(lock_magazine_list, unlock_magazine_list, reset_magazine_list);
+}
+
+/**
+ * @brief Fork handlers keeping the list of threads consistent in the child,
+ *        where only the forking thread is left
+ */
+static void lock_magazine_list(void) {
+  pthread_mutex_lock(&allMagazinesMutex);
+}
+
+static void unlock_magazine_list(void) {
+  pthread_mutex_unlock(&allMagazinesMutex);
+}
+
+static void reset_magazine_list(void) {
+  pthread_mutex_init(&allMagazinesMutex, NULL);
+  allMagazines = NULL;
+  if (magazinesRegistered) {
+    threadMagazines.prev = threadMagazines.next = NULL;
+    allMagazines = &threadMagazines;
+  }
+}
+#endif
+
+/**
+ * @brief Create a pool of fixed size objects
+ *
+ * @param obj_size The size of every object in the pool
+ * @param align The alignment of every object, a power of two no larger than
+ *        a page (0 uses the alignment of a pointer)
+ *
+ * @return The new pool, or NULL with errno set if the arguments are invalid
+ *         or MAX_POOLS pools already exist
+ */
+my_pool * my_pool_create(size_t obj_size, size_t align) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  if (align == 0) {
+    align = sizeof(pool_object);
+  }
+  if (obj_size == 0 || (align & (align - 1)) || align > page) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (align < sizeof(pool_object)) {
+    align = sizeof(pool_object);
+  }
+
+#if POOL_MAGAZINE_SIZE > 0
+  pthread_once(&magazineKeyOnce, create_magazine_key);
+#endif
+
+  pthread_mutex_lock(&poolsMutex);
+  if (numPools == MAX_POOLS) {
+    pthread_mutex_unlock(&poolsMutex);
+    errno = ENOMEM;
+    return NULL;
+  }
+  my_pool * pool = &pools[numPools];
+  pool->id = numPools++;
+  pthread_mutex_unlock(&poolsMutex);
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pool->align = align;
+  pool->obj_size = round_up(obj_size, align);
+
+  // Slabs are a single page unless that would hold too few objects
+  size_t min_slab = round_up(sizeof(pool_slab), align) +
+                    POOL_MIN_OBJECTS * pool->obj_size;
+  pool->slab_size = round_up(min_slab > page ? min_slab : page, page);
+
+  pool->freelist = NULL;
+  pool->bump = NULL;
+  pool->end = NULL;
+  pool->slabs = NULL;
+  pool->numSlabs = 0;
+  return pool;
+}
+
+/**
+ * @brief Allocate one object from a pool
+ *
+ * @param pool The pool to allocate from
+ *
+ * @return A pointer to obj_size bytes aligned to the pool's alignment or NULL
+ *         if the OS is out of memory
+ */
+void * my_pool_alloc(my_pool * pool) {
+#if POOL_MAGAZINE_SIZE > 0
+  magazine * mag = &magazines[pool->id];
+  if (mag->count == 0) {
+    refill_magazine(pool, mag);
+    if (mag->count == 0) {
+      errno = ENOMEM;
+      return NULL;
+    }
+  }
+  return mag->objects[--mag->count];
+#else
+  pthread_mutex_lock(&pool->lock);
+  void * obj = pool_get_object(pool);
+  pthread_mutex_unlock(&pool->lock);
+  if (!obj) {
+    errno = ENOMEM;
+  }
+  return obj;
+#endif
+}
+
+/**
+ * @brief Return an object to the pool it was allocated from
+ *
+ * @param pool The pool the object was allocated from
+ * @param p The object to free, may be NULL
+ */
+void my_pool_free(my_pool * pool, void * p) {
+  if (!p) {
+    return;
+  }
+
+#if POOL_MAGAZINE_SIZE > 0
+  // A thread that only frees into a pool still fills its magazine
+  register_magazines();
+  magazine * mag = &magazines[pool->id];
+  if (mag->count == POOL_MAGAZINE_SIZE) {
+    flush_magazine(pool, mag, (POOL_MAGAZINE_SIZE + 1) / 2);
+  }
+  mag->objects[mag->count++] = p;
+#else
+  pthread_mutex_lock(&pool->lock);
+  pool_put_object(pool, p);
+  pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+/**
+ * @brief Write the objects cached in each thread's magazines as the entries
+ *        of the pool_magazines array in my_malloc_info
+ *
+ * @param out The stream to write to
+ */
+void my_pool_magazines_info(FILE * out) {
+#if POOL_MAGAZINE_SIZE > 0
+  pthread_mutex_lock(&poolsMutex);
+  int n_pools = numPools;
+  pthread_mutex_unlock(&poolsMutex);
+
+  // The threads are walked again for each one so that no lock is held while
+  // its magazines are written
+  for (size_t n = 0; ; n++) {
+    size_t counts[MAX_POOLS];
+    pthread_mutex_lock(&allMagazinesMutex);
+    thread_magazines * t = allMagazines;
+    for (size_t i = 0; t && i < n; i++) {
+      t = t->next;
+    }
+    bool calling = t == &threadMagazines;
+    for (int i = 0; t && i < n_pools; i++) {
+      // The owner changes its counts without a lock, this is a snapshot
+      counts[i] = __atomic_load_n(&t->magazines[i].count, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&allMagazinesMutex);
+    if (!t) {
+      break;
+    }
+
+    fprintf(out, "%s\n      {\"calling\": %s, \"magazines\": [", n ? "," : "",
+            calling ? "true" : "false");
+    bool first = true;
+    for (int i = 0; i < n_pools; i++) {
+      if (counts[i]) {
+        fprintf(out, "%s\n        {\"pool\": %d, \"objects\": %zu, "
+                "\"capacity\": %d}", first ? "" : ",", i, counts[i],
+                POOL_MAGAZINE_SIZE);
+        first = false;
+      }
+    }
+    fprintf(out, "\n      ]}");
+  }
+#else
+  (void) out;
+#endif
+}
@@ -0,0 +1,81 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MAX_POOLS
+// If not specified at compile time use the default maximum number of pools
+#define MAX_POOLS 32
+#endif
+
+#ifndef POOL_MAGAZINE_SIZE
+// Number of objects each thread may cache per pool, 0 disables the magazines
+#define POOL_MAGAZINE_SIZE 32
+#endif
+
+/* The minimum number of objects carved out of each slab */
+#define POOL_MIN_OBJECTS 8
+
+/*
+ * A free object in a pool. The link is stored in the first word of the
+ * object itself so a pool carries no per-object metadata.
+ */
+typedef struct pool_object {
+  struct pool_object * next;
+} pool_object;
+
+/*
+ * Header placed at the start of every slab requested from the OS so the
+ * slabs of a pool can be walked
+ */
+typedef struct pool_slab {
+  struct pool_slab * next;
+} pool_slab;
+
+/*
+ * A pool hands out fixed size objects from page sized slabs
+ *
+ * FIELDS
+ * pthread_mutex_t lock Protects every field below
+ * size_t obj_size The size of each object rounded up to align
+ * size_t align The alignment of each object
+ * size_t slab_size The size of each slab requested from the OS
+ * pool_object * freelist Intrusive list of objects that have been freed
+ * char * bump The next never used object in the newest slab
+ * char * end The end of the newest slab
+ * pool_slab * slabs List of all slabs owned by the pool
+ * size_t numSlabs Number of slabs owned by the pool
+ * int id Index of the pool used to find each thread's magazine
+ */
+typedef struct my_pool {
+  pthread_mutex_t lock;
+  size_t obj_size;
+  size_t align;
+  size_t slab_size;
+  pool_object * freelist;
+  char * bump;
+  char * end;
+  pool_slab * slabs;
+  size_t numSlabs;
+  int id;
+} my_pool;
+
+// Pool interface
+my_pool * my_pool_create(size_t obj_size, size_t align);
+void * my_pool_alloc(my_pool * pool);
+void my_pool_free(my_pool * pool, void * p);
+
+// Write every thread's magazines, called by my_malloc_info
+void my_pool_magazines_info(FILE * out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POOL_H
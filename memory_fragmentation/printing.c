@@ -43,6 +43,7 @@ static inline const char * allocated_to_string(char allocated) {
     case UNALLOCATED: 
       return "false";
     case ALLOCATED:
+    case SPAN_OBJECT:
       return "true";
     case FENCEPOST:
       return "fencepost";
@@ -75,6 +76,7 @@ static void print_color(header * block) {
       printf("\033[0;32m");
       break;
     case ALLOCATED:
+    case SPAN_OBJECT:
       printf("\033[0;34m");
       break;
     case FENCEPOST:
@@ -159,6 +161,7 @@ void print_status(header * block) {
       printf("[U]");
       break;
     case ALLOCATED:
+    case SPAN_OBJECT:
       printf("[A]");
       break;
     case FENCEPOST:
@@ -217,6 +220,19 @@ void freelist_print(printFormatter pf) {
     }
     fflush(stdout);
   }
+
+#if N_QUICK_LISTS > 0
+  for (size_t i = 0; i <= N_QUICK_LISTS; i++) {
+    if (quickLists[i]) {
+      printf("Q%zu: ", i);
+      for (header * cur = quickLists[i]; cur; cur = cur->next) {
+        pf(cur);
+      }
+      puts("");
+    }
+    fflush(stdout);
+  }
+#endif
 }
 
 /**
@@ -241,3 +257,21 @@ void tags_print(printFormatter pf) {
     fflush(stdout);
   }
 }
+
+/**
+ * @brief print the memory held by each allocation tag that has been used or
+ *        named
+ */
+void tag_stats_print() {
+  for (unsigned tag = 1; tag < MAX_TAGS; tag++) {
+    tag_stats stats;
+    my_malloc_tag_stats(tag, &stats);
+    if (!stats.name && !stats.total_allocations) {
+      continue;
+    }
+    printf("tag %u %s: %zu bytes in %zu allocations, %zu allocations made\n",
+           tag, stats.name ? stats.name : "(unnamed)", stats.live_bytes,
+           stats.live_allocations, stats.total_allocations);
+  }
+  fflush(stdout);
+}
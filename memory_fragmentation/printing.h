@@ -23,6 +23,9 @@ void print_status(header * block);
 void freelist_print(printFormatter pf);
 void tags_print(printFormatter pf);
 
+/* Print the memory held by each allocation tag */
+void tag_stats_print();
+
 /* Helpers */
 void print_sublist(printFormatter pf, header * start, header * end);
 void print_pointer(void * p);
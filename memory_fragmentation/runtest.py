@@ -1,4 +1,6 @@
 #!/usr/bin/python3
+import json;
+import statistics;
 import subprocess;
 import sys;
 
@@ -40,11 +42,46 @@ otherTests = [('test_locks', 3), \
               ];
 
 myTests = [('test_exact', 1),\
+            ('test_pool', 1),\
+            ('test_locks_pthread', 1),\
+            ('test_threads', 1),\
+            ('test_quick_lists', 1),\
+            ('test_malloc_huge', 1),\
+            ('test_invalid_free', 1),\
+            ('test_arena_mmap', 1),\
+            ('test_fork_reset', 1),\
+            ('test_guard', 1),\
+            ('test_guard_sampling', 1),\
+            ('test_verify_step', 1),\
+            ('test_aligned_alloc', 1),\
+            ('test_fit_first', 1),\
+            ('test_fit_best', 1),\
+            ('test_fit_next', 1),\
+            ('test_fit_good', 1),\
+            ('test_size_classes', 1),\
+            ('test_limit', 1),\
+            ('test_handles', 1),\
+            ('test_isolated', 1),\
+            ('test_scratch', 1),\
+            ('test_usable_size', 1),\
+            ('test_tags', 1),\
+            ('test_background', 1),\
+            ('test_malloc_info', 1),\
+            ('test_thread_caches', 1),\
             # Add your additional tests here
             # They will be run when running `./runtest all`
             # and will not be counted in the total score
            ]
 
+# Benchmarks run by `./runtest.py perf`, each prints one line of JSON per run
+# and its medians are compared against the checked in baseline
+perfBenchmarks = ['bench_counters', \
+                  'bench_counters_geometric', \
+                  ];
+
+perfBaseline = 'bench/baseline.json';
+perfRuns = 5;
+
 def color(c, s):
     return c + s + '\033[0m';
 
@@ -99,6 +136,65 @@ def runSuite(name, suite, verbose, indentby):
 
     return (pointsEarned, totalPoints);
 
+def metricValue(run, metric):
+    value = run;
+    for key in metric.split('.'):
+        value = value[key];
+    return value;
+
+def runBenchmark(name, runs):
+    out = subprocess.check_output(['bench/' + name, str(runs)]).decode('utf-8');
+    return [json.loads(line) for line in out.splitlines() if line];
+
+# Run every benchmark in perfBenchmarks and compare the median of each metric
+# in the baseline against it. Every metric is a cost, so a median more than its
+# tolerance above the baseline is a regression. Metrics a run could not
+# measure, such as hardware counters without a PMU, are skipped. With update
+# the baseline medians are replaced by the new ones and tolerances are kept.
+def runPerf(runs, update):
+    subprocess.check_call(['make', '-s', '-C', 'bench'] + perfBenchmarks);
+    with open(perfBaseline) as f:
+        baseline = json.load(f);
+
+    regressions = 0;
+    print(blue('SUITE: Performance, median of ' + str(runs) + ' runs'));
+    for name in perfBenchmarks:
+        results = runBenchmark(name, runs);
+        indent(1);
+        print(blue('BENCH: ' + name));
+        for metric, expected in baseline['benchmarks'][name].items():
+            values = [metricValue(run, metric) for run in results];
+            indent(2);
+            if (None in values):
+                print(yellow('%-42s not measured' % metric));
+                continue;
+            median = statistics.median(values);
+            stdev = statistics.stdev(values) if len(values) > 1 else 0;
+            line = '%-42s median %14.1f stdev %12.1f' % (metric, median, stdev);
+            if (update or expected['median'] is None):
+                print(line if update else yellow(line + ' no baseline'));
+                expected['median'] = median if update else None;
+                continue;
+            change = median / expected['median'] - 1 if expected['median'] else 0;
+            line += ' baseline %14.1f %+7.1f%%' % (expected['median'], change * 100);
+            if (change > expected['tolerance']):
+                regressions += 1;
+                print(red(line + ' REGRESSED'));
+            else:
+                print(green(line));
+        print();
+
+    if (update):
+        with open(perfBaseline, 'w') as f:
+            json.dump(baseline, f, indent=2);
+            f.write('\n');
+        print('Updated ' + perfBaseline);
+    elif (regressions):
+        print(red('Regressions: ' + str(regressions)));
+    else:
+        print(green('Regressions: 0'));
+    return regressions == 0;
+
 verbose = False;
 pointsEarned = 0;
 totalPoints = 0;
@@ -107,6 +203,17 @@ if (len(sys.argv) == 3 and sys.argv[1] == '-t'):
     runTest(sys.argv[2], 0, True, 0);
     exit(0);
 
+# `./runtest.py [all] perf [runs]` also gates on performance and exits non-zero
+# on a failed test or a regression, `perf update` rewrites the baseline
+args = sys.argv[1:];
+perf = 'perf' in args;
+if (perf):
+    perfArgs = args[args.index('perf') + 1:];
+    if ('update' in perfArgs):
+        exit(0 if runPerf(perfRuns, True) else 1);
+    if (perfArgs):
+        perfRuns = int(perfArgs[0]);
+
 ret = runSuite('Simple Tests', simpleTests, verbose, 0);
 pointsEarned += ret[0];
 totalPoints += ret[1];
@@ -136,6 +243,14 @@ print(fmtColor('\nTotal: ' + str(pointsEarned) + '/' + str(totalPoints)));
 print('\nNOTE:\n' +
       'Additional tests worth an additional 10 points will be used for the final grading');
 
-if (len(sys.argv) == 2 and sys.argv[1] == 'all'):
+passed = pointsEarned == totalPoints;
+
+if (args[:1] == ['all']):
     print();
     ret = runSuite('My Tests', myTests, verbose, 0);
+    passed = passed and ret[0] == ret[1];
+
+if (perf):
+    print();
+    passed = runPerf(perfRuns, False) and passed;
+    exit(0 if passed else 1);
@@ -0,0 +1,108 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "scratch.h"
+
+/*
+ * The calling thread's scratch stack, empty until its first allocation
+ */
+__thread my_scratch_stack myScratch;
+
+/*
+ * Key used only for its destructor so that a thread's region is unmapped
+ * when the thread exits
+ */
+static pthread_key_t scratchKey;
+static pthread_once_t scratchKeyOnce = PTHREAD_ONCE_INIT;
+
+// Helper functions for managing the region of a thread
+static bool reserve_scratch(my_scratch_stack * s);
+static void release_scratch(void * unused);
+static void create_scratch_key(void);
+
+/**
+ * @brief Reserve the calling thread's region, none of it is accessible until
+ *        it is committed
+ *
+ * @param s The calling thread's scratch stack
+ *
+ * @return true if the region was reserved
+ */
+static bool reserve_scratch(my_scratch_stack * s) {
+  char * mem = mmap(NULL, SCRATCH_RESERVE_SIZE, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mem == MAP_FAILED) {
+    return false;
+  }
+
+  pthread_once(&scratchKeyOnce, create_scratch_key);
+  // Any non NULL value makes the destructor run when the thread exits
+  pthread_setspecific(scratchKey, mem);
+
+  // Marks taken before now are NULL, my_scratch_release maps them to base
+  s->top = mem;
+  s->base = mem;
+  s->committed = mem;
+  s->end = mem + SCRATCH_RESERVE_SIZE;
+  return true;
+}
+
+/**
+ * @brief Thread exit destructor unmapping the thread's region
+ *
+ * @param unused The value registered with the key
+ */
+static void release_scratch(void * unused) {
+  (void) unused;
+  my_scratch_stack * s = &myScratch;
+  munmap(s->base, s->end - s->base);
+  s->top = s->committed = s->base = s->end = NULL;
+}
+
+static void create_scratch_key(void) {
+  pthread_key_create(&scratchKey, release_scratch);
+}
+
+/**
+ * @brief Allocate from the calling thread's scratch stack when the committed
+ *        part of the region is too small, committing more of it
+ *
+ * @param size The number of bytes needed
+ *
+ * @return The memory or NULL with errno set to ENOMEM if the region is full
+ */
+void * my_scratch_grow(size_t size) {
+  my_scratch_stack * s = &myScratch;
+  if (!s->base && !reserve_scratch(s)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  size_t rounded = (size + SCRATCH_ALIGNMENT - 1) & ~(size_t) (SCRATCH_ALIGNMENT - 1);
+  if (rounded < size || rounded > (size_t) (s->end - s->top)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  char * top = s->top + rounded;
+  if (top > s->committed) {
+    size_t grow = (top - s->committed + SCRATCH_COMMIT_SIZE - 1) &
+                  ~(SCRATCH_COMMIT_SIZE - 1);
+    if (grow > (size_t) (s->end - s->committed)) {
+      grow = s->end - s->committed;
+    }
+    if (mprotect(s->committed, grow, PROT_READ | PROT_WRITE) != 0) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    s->committed += grow;
+  }
+
+  char * p = s->top;
+  s->top = top;
+  return p;
+}
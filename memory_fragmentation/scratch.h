@@ -0,0 +1,89 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SCRATCH_RESERVE_SIZE
+// Address space reserved for each thread's scratch stack, the most it can hold
+#define SCRATCH_RESERVE_SIZE ((size_t) 64 << 20)
+#endif
+
+#ifndef SCRATCH_COMMIT_SIZE
+// The reserved region is made accessible in steps of this many bytes
+#define SCRATCH_COMMIT_SIZE ((size_t) 64 << 10)
+#endif
+
+/* Alignment of every scratch allocation */
+#define SCRATCH_ALIGNMENT 16
+
+/*
+ * A thread's scratch stack, a region of address space reserved with mmap on
+ * first use and released when the thread exits. Allocations are carved from
+ * the top with no header and are freed all at once by resetting the top to a
+ * mark, so they must be strictly nested.
+ *
+ * FIELDS
+ * char * top The next free byte
+ * char * committed The end of the accessible part of the region
+ * char * base The start of the region or NULL before the first allocation
+ * char * end The end of the region
+ */
+typedef struct my_scratch_stack {
+  char * top;
+  char * committed;
+  char * base;
+  char * end;
+} my_scratch_stack;
+
+extern __thread my_scratch_stack myScratch;
+
+// Slow path making more of the region accessible, or reserving it
+void * my_scratch_grow(size_t size);
+
+/**
+ * @brief Remember the top of the calling thread's scratch stack
+ *
+ * @return A mark to pass to my_scratch_release
+ */
+static inline void * my_scratch_mark() {
+  return myScratch.top;
+}
+
+/**
+ * @brief Allocate from the calling thread's scratch stack
+ *
+ * @param size The number of bytes needed
+ *
+ * @return The memory, aligned to SCRATCH_ALIGNMENT, or NULL with errno set
+ *         if the region is full
+ */
+static inline void * my_scratch_alloc(size_t size) {
+  size_t rounded = (size + SCRATCH_ALIGNMENT - 1) & ~(size_t) (SCRATCH_ALIGNMENT - 1);
+  char * p = myScratch.top;
+  if (rounded < size || rounded > (size_t) (myScratch.committed - p) || !p) {
+    return my_scratch_grow(size);
+  }
+  myScratch.top = p + rounded;
+  return p;
+}
+
+/**
+ * @brief Free every scratch allocation made since a mark was taken
+ *
+ * @param mark A mark from my_scratch_mark on the same thread
+ */
+static inline void my_scratch_release(void * mark) {
+  // A mark taken before the first allocation is the start of the region
+  myScratch.top = mark ? (char *) mark : myScratch.base;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCRATCH_H
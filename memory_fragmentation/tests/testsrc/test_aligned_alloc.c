@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+static const char * aligned(void * p, size_t alignment) {
+  return (uintptr_t) p % alignment == 0 ? "true" : "false";
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  printf("Every block is aligned to MALLOC_ALIGNMENT\n");
+  void * ptrs[5];
+  const char * all = "true";
+  for (size_t i = 0; i < 5; i++) {
+    ptrs[i] = mallocing(1 + i * 7, print_status, false);
+    if ((uintptr_t) ptrs[i] % MALLOC_ALIGNMENT) {
+      all = "false";
+    }
+  }
+  printf("aligned: %s\n\n", all);
+
+  printf("Aligning to 64 returns the front and back of the block to the freelist\n");
+  void * p = my_aligned_alloc(64, 40);
+  tags_print(print_status);
+  puts("");
+  printf("aligned: %s\n\n", aligned(p, 64));
+
+  printf("Aligning to 256\n");
+  void * q = my_aligned_alloc(256, 8);
+  tags_print(print_status);
+  puts("");
+  printf("aligned: %s\n\n", aligned(q, 256));
+
+  printf("Small alignments are served by my_malloc\n");
+  void * r = my_aligned_alloc(8, 8);
+  printf("aligned: %s\n", aligned(r, MALLOC_ALIGNMENT));
+  printf("Alignments that are not a power of two fail: %s\n\n",
+         my_aligned_alloc(24, 8) == NULL ? "true" : "false");
+
+  freeing(p, 40, print_status, false);
+  freeing(q, 8, print_status, false);
+  freeing(r, 8, print_status, false);
+  for (size_t i = 0; i < 5; i++) {
+    freeing(ptrs[i], 1 + i * 7, print_status, false);
+  }
+
+  finalize_test();
+}
@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+#define NALLOCS 8
+
+int main() {
+  initialize_test(__FILE__);
+  void * ptrs[NALLOCS];
+
+  printf("heap is huge page aligned: %s\n",
+         (uintptr_t) base % HUGE_PAGE_SIZE == 0 ? "true" : "false");
+
+  // Chunks carved from the same region are adjacent and coalesce
+  mallocing_loop(ptrs, ARENA_SIZE / 2, NALLOCS, print_status, false);
+  freeing_loop(ptrs, ARENA_SIZE / 2, NALLOCS, print_status, false);
+
+  // A request larger than the region reserves a region of its own, the
+  // block is carved from the right of the chunk after the remainder
+  void * p = mallocing(ARENA_RESERVE_SIZE, print_status, false);
+  header * h = (header *) ((char *) p - ALLOC_HEADER_SIZE);
+  char * chunk = (char *) h - h->left_size - ALLOC_HEADER_SIZE;
+  printf("large chunk is huge page aligned: %s\n",
+         (uintptr_t) chunk % HUGE_PAGE_SIZE == 0 ? "true" : "false");
+  my_free(p);
+  tags_print(print_status);
+  puts("");
+
+  finalize_test();
+}
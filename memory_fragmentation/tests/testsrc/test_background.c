@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+/*
+ * Sleep long enough for the background thread to run several times
+ */
+static void wait_ms(long ms) {
+  struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L };
+  nanosleep(&ts, NULL);
+}
+
+/*
+ * Report whether the page after the one holding p is resident
+ */
+static bool next_page_resident(void * p) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  void * next = (void *) (((uintptr_t) p + page) & ~(uintptr_t) (page - 1));
+  unsigned char vec;
+  mincore(next, page, &vec);
+  return vec & 1;
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  void * a = my_malloc(40);
+  void * b = my_malloc(40);
+  void * spacer = my_malloc(8);
+
+  printf("Freeing two neighbors, they wait on the pending list\n");
+  my_free(a);
+  my_free(b);
+  tags_print(print_status);
+  puts("");
+
+  printf("After the background thread runs they are coalesced\n");
+  wait_ms(5 * BACKGROUND_INTERVAL_MS);
+  tags_print(print_status);
+  puts("");
+
+  char * big = my_malloc(4 * sysconf(_SC_PAGESIZE));
+  memset(big, 'x', 4 * sysconf(_SC_PAGESIZE));
+  my_free(big);
+  wait_ms(5 * BACKGROUND_INTERVAL_MS);
+  printf("a freed block's pages are kept at first: %s\n",
+         next_page_resident(big) ? "true" : "false");
+  wait_ms(2 * PURGE_DECAY_MS);
+  printf("and purged once it has been free for the decay time: %s\n",
+         !next_page_resident(big) ? "true" : "false");
+  puts("");
+
+  // The blocks freed while the big block sits free, allocated first and with
+  // an allocated block on each side of the big one so they are coalesced
+  // elsewhere
+  void * churn[2 * PURGE_DECAY_MS / BACKGROUND_INTERVAL_MS];
+  for (size_t i = 0; i < sizeof(churn) / sizeof(churn[0]); i++) {
+    churn[i] = my_malloc(40);
+  }
+  void * after = my_malloc(8);
+  big = my_malloc(4 * sysconf(_SC_PAGESIZE));
+  void * before = my_malloc(8);
+  memset(big, 'x', 4 * sysconf(_SC_PAGESIZE));
+  my_free(big);
+  printf("Freeing a block every interval while the big block sits free\n");
+  for (size_t i = 0; i < sizeof(churn) / sizeof(churn[0]); i++) {
+    my_free(churn[i]);
+    wait_ms(BACKGROUND_INTERVAL_MS);
+  }
+  printf("the big block is still purged on time: %s\n",
+         !next_page_resident(big) ? "true" : "false");
+  puts("");
+
+  my_free(before);
+  my_free(after);
+
+  my_free(spacer);
+  wait_ms(5 * BACKGROUND_INTERVAL_MS);
+  printf("heap valid: %s\n", verify() ? "true" : "false");
+
+  finalize_test();
+}
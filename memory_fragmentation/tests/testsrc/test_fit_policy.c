@@ -0,0 +1,66 @@
+#include <stdio.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+/*
+ * Free blocks of these sizes in the last freelist, each kept apart from the
+ * next by a small allocation so they are not coalesced
+ */
+static size_t sizes[] = { 560, 984, 584, 684, 784 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static void * blocks[NSIZES];
+
+/*
+ * Print which of the freed blocks an allocation was carved from
+ */
+static void print_source(void * p) {
+  for (size_t i = 0; i < NSIZES; i++) {
+    if ((char *) p >= (char *) blocks[i] &&
+        (char *) p < (char *) blocks[i] + sizes[i]) {
+      printf("carved from the %zu byte block\n", sizes[i]);
+      return;
+    }
+  }
+  printf("carved from the rest of the chunk\n");
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  void * spacers[NSIZES];
+  for (size_t i = 0; i < NSIZES; i++) {
+    blocks[i] = mallocing(sizes[i], print_status, false);
+    spacers[i] = mallocing(8, print_status, false);
+  }
+  puts("");
+
+  // Freed blocks are pushed on the head of the list, the last one is kept
+  // back to be freed between the two searches
+  for (size_t i = 0; i < NSIZES - 1; i++) {
+    freeing(blocks[i], sizes[i], print_status, false);
+  }
+  puts("");
+
+  printf("Searching the list\n");
+  freelist_print(print_status);
+  void * p = mallocing(550, print_status, false);
+  print_source(p);
+  puts("");
+
+  printf("Searching again after freeing a block to the head of the list\n");
+  freeing(blocks[NSIZES - 1], sizes[NSIZES - 1], print_status, false);
+  freelist_print(print_status);
+  void * q = mallocing(550, print_status, false);
+  print_source(q);
+  puts("");
+
+  freeing(p, 550, print_status, false);
+  freeing(q, 550, print_status, false);
+  for (size_t i = 0; i < NSIZES; i++) {
+    freeing(spacers[i], 8, print_status, false);
+  }
+
+  finalize_test();
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+#define NALLOCS 4
+
+int main() {
+  initialize_test(__FILE__);
+  void * ptrs[NALLOCS];
+
+  mallocing_loop(ptrs, 64, NALLOCS, print_status, false);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    // The child only sees a fresh arena and leaks inherited blocks
+    printf("In the child\n");
+    tags_print(print_status);
+    puts("");
+    printf("Freeing a block inherited from the parent\n");
+    my_free(ptrs[0]);
+    void * p = mallocing(64, print_status, false);
+    freeing(p, 64, print_status, false);
+    printf("child heap valid: %s\n\n", verify() ? "true" : "false");
+    exit(0);
+  }
+  waitpid(pid, NULL, 0);
+
+  printf("In the parent\n");
+  tags_print(print_status);
+  puts("");
+  freeing_loop(ptrs, 64, NALLOCS, print_status, false);
+
+  // Freed memory is not zeroed, a block split out of a free block filled
+  // with set bits must not pick them up in its boundary tags
+  char * dirty = my_malloc(400);
+  void * spacer = my_malloc(8);
+  memset(dirty, 0xff, 400);
+  my_free(dirty);
+  char * c = mallocing(100, print_status, false);
+  printf("split from the dirty block: %s\n",
+         c > dirty && c < dirty + 400 ? "true" : "false");
+  printf("heap valid: %s\n\n", verify() ? "true" : "false");
+  freeing(c, 100, print_status, false);
+  my_free(spacer);
+
+  finalize_test();
+}
@@ -0,0 +1,89 @@
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+/*
+ * Run a bad access in a child with its reports on stdout and print how the
+ * child ended
+ */
+static void expect_crash(const char * what, void (*bad)(char *), char * p) {
+  printf("%s\n", what);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(1, 2);
+    bad(p);
+    printf("no crash\n");
+    exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (WIFSIGNALED(status)) {
+    printf("child killed by %s\n\n", strsignal(WTERMSIG(status)));
+  } else {
+    printf("child exited with %d\n\n", WEXITSTATUS(status));
+  }
+}
+
+static void overflow(char * p) {
+  p[16] = 1;
+}
+
+static void underflow(char * p) {
+  // Only the end of an allocation is against a guard page, an underflow is
+  // caught once it leaves the slot's page
+  size_t page = sysconf(_SC_PAGESIZE);
+  p[-(long) (page - 16) - 1] = 1;
+}
+
+static void padding_overflow(char * p) {
+  p[13] = 1;
+  my_free(p);
+}
+
+static void use_after_free(char * p) {
+  my_free(p);
+  p[0] = 1;
+}
+
+int main() {
+  initialize_test(__FILE__);
+  size_t page = sysconf(_SC_PAGESIZE);
+
+  // With a sample rate of 1 every allocation is guarded while slots are free
+  char * p = my_malloc(13);
+  printf("13 byte allocation ends 3 bytes before a page: %s\n",
+         ((uintptr_t) p + 16) % page == 0 ? "true" : "false");
+  printf("memory is zeroed: %s\n\n", p[0] == 0 && p[12] == 0 ? "true" : "false");
+
+  expect_crash("Writing past the rounded end", overflow, p);
+  expect_crash("Writing before the start of the page", underflow, p);
+  expect_crash("Writing into the padding and freeing", padding_overflow, p);
+  expect_crash("Writing after freeing", use_after_free, p);
+
+  printf("Reallocating keeps the contents\n");
+  strcpy(p, "guarded");
+  p = my_realloc(p, 32);
+  printf("%s\n", p);
+  my_free(p);
+
+  printf("Allocations fall back to the heap once every slot is in use\n");
+  void * ptrs[GUARD_SLOTS + 1];
+  for (int i = 0; i <= GUARD_SLOTS; i++) {
+    ptrs[i] = my_malloc(8);
+  }
+  tags_print(print_status);
+  puts("");
+  for (int i = 0; i <= GUARD_SLOTS; i++) {
+    my_free(ptrs[i]);
+  }
+
+  finalize_test();
+}
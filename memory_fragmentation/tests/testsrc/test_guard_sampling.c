@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+#define N_PAIRS 4000
+
+int main() {
+  initialize_test(__FILE__);
+  size_t page = sysconf(_SC_PAGESIZE);
+
+  // Every other allocation is too large for a slot. A sample that falls on
+  // one is kept for the next small allocation, so about one small
+  // allocation in two is sampled instead of one in four.
+  size_t sampled = 0;
+  for (int i = 0; i < N_PAIRS; i++) {
+    void * large = my_malloc(2 * page);
+    void * small = my_malloc(8);
+    // A heap block holds at least 16 bytes, a slot exactly what was asked
+    sampled += my_malloc_usable_size(small) == 8;
+    my_free(small);
+    my_free(large);
+  }
+  printf("samples are kept for allocations that fit a slot: %s\n",
+         sampled > N_PAIRS * 3 / 8 ? "true" : "false");
+
+  finalize_test();
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+#define N_HANDLES 8
+#define HANDLE_SIZE 40
+
+static my_handle handles[N_HANDLES];
+
+/*
+ * Check that every byte of a handle's block still holds the value it was
+ * filled with
+ */
+static bool holds_data(int i) {
+  char * p = my_hpin(handles[i]);
+  bool intact = true;
+  for (int j = 0; j < HANDLE_SIZE; j++) {
+    intact = intact && p[j] == 'a' + i;
+  }
+  my_hunpin(handles[i]);
+  return intact;
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  // A block from my_malloc in the middle never moves
+  void * fixed = NULL;
+  for (int i = 0; i < N_HANDLES; i++) {
+    if (i == N_HANDLES / 2) {
+      fixed = mallocing(HANDLE_SIZE, print_status, true);
+    }
+    handles[i] = my_halloc(HANDLE_SIZE);
+    memset(my_hpin(handles[i]), 'a' + i, HANDLE_SIZE);
+    my_hunpin(handles[i]);
+  }
+  for (int i = 0; i < N_HANDLES; i += 2) {
+    my_hfree(handles[i]);
+    handles[i] = NULL;
+  }
+  char * pinned = my_hpin(handles[5]);
+  // The handle's back pointer in the last word of the block is not usable
+  printf("handle 5 has %zu usable bytes\n", my_malloc_usable_size(pinned));
+
+  printf("Before compacting, handle 5 is pinned\n");
+  tags_print(print_status);
+  puts("");
+  freelist_print(print_status);
+  puts("");
+
+  printf("Compacting moved %zu blocks\n", my_compact());
+  tags_print(print_status);
+  puts("");
+  freelist_print(print_status);
+  for (int i = 1; i < N_HANDLES; i += 2) {
+    printf("handle %d holds its data: %s\n", i, holds_data(i) ? "true" : "false");
+  }
+  printf("The pinned block did not move: %s\n",
+         my_hpin(handles[5]) == pinned ? "true" : "false");
+  my_hunpin(handles[5]);
+  puts("");
+
+  my_hunpin(handles[5]);
+  printf("Compacting after unpinning moved %zu blocks\n", my_compact());
+  tags_print(print_status);
+  puts("");
+  freelist_print(print_status);
+  printf("handle 5 holds its data: %s\n", holds_data(5) ? "true" : "false");
+  puts("");
+
+  for (int i = 1; i < N_HANDLES; i += 2) {
+    my_hfree(handles[i]);
+  }
+  freeing(fixed, HANDLE_SIZE, print_status, true);
+
+  finalize_test();
+}
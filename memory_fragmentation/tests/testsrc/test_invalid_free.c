@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+static char global[64];
+
+int main() {
+  initialize_test(__FILE__);
+  char local[64];
+
+  char * p = mallocing(64, print_status, false);
+  char * q = mallocing(8, print_status, false);
+  void * foreign = malloc(64);
+  memset(p, 0x5a, 64);
+
+  printf("Freeing a pointer to the stack\n");
+  my_free(local + 16);
+  printf("Freeing a pointer to a global\n");
+  my_free(global + 16);
+  printf("Freeing a pointer from the system malloc\n");
+  my_free(foreign);
+  printf("Freeing a pointer into the middle of a block\n");
+  my_free(p + 32);
+  printf("Freeing a misaligned pointer\n");
+  my_free(p + 3);
+  puts("");
+
+  printf("Verify the heap is untouched and can still be freed\n");
+  memset(p, 0, 64);
+  freeing(p, 64, print_status, false);
+  freeing(q, 8, print_status, false);
+  free(foreign);
+
+  finalize_test();
+}
@@ -0,0 +1,89 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+#define N_THREADS 2
+#define N_OBJECTS 32
+#define OBJECT_SIZE 8
+
+static void * objects[N_THREADS][N_OBJECTS];
+static pthread_barrier_t barrier;
+
+static uintptr_t line_of(void * p) {
+  return (uintptr_t) p / CACHE_LINE_SIZE;
+}
+
+/*
+ * Whether two objects of the given sizes touch a common line
+ */
+static bool share_line(char * p, size_t n, char * q, size_t m) {
+  return line_of(p) <= line_of(q + m - 1) && line_of(q) <= line_of(p + n - 1);
+}
+
+/*
+ * Each thread allocates in turn with the other, so without THREAD_LINES
+ * their objects would be carved next to each other. Afterwards each thread
+ * frees the other's objects.
+ */
+static void * run(void * arg) {
+  int id = (int) (intptr_t) arg;
+  for (int i = 0; i < N_OBJECTS; i++) {
+    for (int turn = 0; turn < N_THREADS; turn++) {
+      if (turn == id) {
+        objects[id][i] = my_malloc(OBJECT_SIZE);
+      }
+      pthread_barrier_wait(&barrier);
+    }
+  }
+  pthread_barrier_wait(&barrier);
+  for (int i = 0; i < N_OBJECTS; i++) {
+    my_free(objects[(id + 1) % N_THREADS][i]);
+  }
+  return NULL;
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  // Each object covers whole lines, b takes two
+  char * a = my_malloc_isolated(1);
+  char * b = my_malloc_isolated(CACHE_LINE_SIZE + 1);
+  char * c = my_malloc_isolated(1);
+  printf("isolated objects start a line: %s\n",
+         (uintptr_t) a % CACHE_LINE_SIZE == 0 && (uintptr_t) b % CACHE_LINE_SIZE == 0 &&
+         (uintptr_t) c % CACHE_LINE_SIZE == 0 ? "true" : "false");
+  printf("isolated objects share a line: %s\n",
+         share_line(a, CACHE_LINE_SIZE, b, 2 * CACHE_LINE_SIZE) ||
+         share_line(b, 2 * CACHE_LINE_SIZE, c, CACHE_LINE_SIZE) ||
+         share_line(a, CACHE_LINE_SIZE, c, CACHE_LINE_SIZE) ? "true" : "false");
+  my_free(a);
+  my_free(b);
+  my_free(c);
+  puts("");
+
+  pthread_barrier_init(&barrier, NULL, N_THREADS);
+  pthread_t threads[N_THREADS];
+  for (int i = 0; i < N_THREADS; i++) {
+    pthread_create(&threads[i], NULL, run, (void *) (intptr_t) i);
+  }
+  for (int i = 0; i < N_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  bool shared = false;
+  for (int i = 0; i < N_OBJECTS; i++) {
+    for (int j = 0; j < N_OBJECTS; j++) {
+      shared = shared || line_of(objects[0][i]) == line_of(objects[1][j]);
+    }
+  }
+  printf("%d threads allocated %d objects each in turn\n", N_THREADS, N_OBJECTS);
+  printf("objects of different threads share a line: %s\n", shared ? "true" : "false");
+  printf("spans returned to the heap after freeing from the other thread: %s\n",
+         verify() ? "true" : "false");
+  puts("");
+
+  finalize_test();
+}
@@ -0,0 +1,69 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+#define BLOCK_SIZE 1000
+#define N_BLOCKS 32
+
+/*
+ * A cache the soft limit callback empties, its entries are allocations the
+ * program could recompute
+ */
+static void * cache[4];
+
+static void drop_cache(size_t heap_bytes, size_t soft_limit) {
+  size_t dropped = 0;
+  for (size_t i = 0; i < sizeof(cache) / sizeof(cache[0]); i++) {
+    if (cache[i]) {
+      my_free(cache[i]);
+      cache[i] = NULL;
+      dropped++;
+    }
+  }
+  printf("heap of %zu bytes is over the soft limit of %zu, dropped %zu cache entries\n",
+         heap_bytes, soft_limit, dropped);
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  printf("A soft limit above the hard limit is rejected: %s\n",
+         !my_malloc_set_limit(ARENA_SIZE, 2 * ARENA_SIZE, NULL) && errno == EINVAL
+             ? "true" : "false");
+
+  for (size_t i = 0; i < sizeof(cache) / sizeof(cache[0]); i++) {
+    cache[i] = mallocing(BLOCK_SIZE, print_status, true);
+  }
+  my_malloc_set_limit(4 * ARENA_SIZE, 2 * ARENA_SIZE, drop_cache);
+
+  printf("Allocating until the hard limit of %d bytes is reached\n", 4 * ARENA_SIZE);
+  void * blocks[N_BLOCKS];
+  size_t n = 0;
+  while (n < N_BLOCKS && (blocks[n] = my_malloc(BLOCK_SIZE))) {
+    n++;
+  }
+  printf("%zu blocks allocated, then my_malloc failed with %s\n", n, strerror(errno));
+  puts("");
+
+  printf("Memory freed below the hard limit can be allocated again\n");
+  my_free(blocks[--n]);
+  blocks[n] = my_malloc(BLOCK_SIZE);
+  printf("%s\n", blocks[n] ? "allocated" : "failed");
+  n++;
+  puts("");
+
+  printf("Removing the limits lets the heap grow again\n");
+  my_malloc_set_limit(0, 0, NULL);
+  void * p = my_malloc(BLOCK_SIZE);
+  printf("%s\n", p ? "allocated" : "failed");
+  my_free(p);
+
+  while (n > 0) {
+    my_free(blocks[--n]);
+  }
+
+  finalize_test();
+}
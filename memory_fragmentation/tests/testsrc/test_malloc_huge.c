@@ -0,0 +1,56 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+#define GB ((size_t) 1 << 30)
+
+/*
+ * Allocate a block too large for an int and check its header covers the
+ * request. Only the ends are touched so the memory never becomes resident.
+ */
+static void huge_malloc(size_t size) {
+  printf("Mallocing %zu bytes\n", size);
+  char * p = my_malloc(size);
+  if (p == NULL) {
+    printf("FAILED: allocation returned NULL\n");
+    return;
+  }
+  p[0] = 1;
+  p[size - 1] = 1;
+
+  header * h = (header *) (p - ALLOC_HEADER_SIZE);
+  printf("block size covers request: %s\n",
+         get_size(h) >= size + ALLOC_HEADER_SIZE ? "true" : "false");
+  my_free(p);
+}
+
+/*
+ * Check a request that cannot be satisfied fails cleanly with ENOMEM
+ */
+static void expect_enomem(const char * what, void * p) {
+  printf("%s: %s\n", what,
+         p == NULL && errno == ENOMEM ? "NULL with ENOMEM" : "FAILED");
+  errno = 0;
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  huge_malloc(2 * GB + 8);
+  huge_malloc(4 * GB + 8);
+  puts("");
+
+  expect_enomem("malloc(SIZE_MAX)", my_malloc(SIZE_MAX));
+  expect_enomem("malloc(SIZE_MAX - ARENA_SIZE)", my_malloc(SIZE_MAX - ARENA_SIZE));
+  expect_enomem("calloc overflowing nmemb * size", my_calloc(SIZE_MAX / 2 + 1, 2));
+  puts("");
+
+  printf("Verify that malloc still works after invalid requests\n");
+  void * ptr = mallocing(8, print_status, false);
+  freeing(ptr, 8, print_status, false);
+
+  finalize_test();
+}
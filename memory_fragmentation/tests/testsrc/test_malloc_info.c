@@ -0,0 +1,25 @@
+#include <stdio.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+int main() {
+  initialize_test(__FILE__);
+
+  void * a = my_malloc(8);
+  void * b = my_malloc(100);
+  void * c = my_malloc(8);
+  my_malloc_tag_name(1, "parser \"ast\"");
+  void * t = my_malloc_tagged(64, 1);
+  my_free(b);
+  my_handle h = my_halloc(32);
+
+  my_malloc_info(stdout);
+  puts("");
+
+  my_hfree(h);
+  my_free(t);
+  my_free(c);
+  my_free(a);
+  finalize_test();
+}
@@ -0,0 +1,87 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "testing.h"
+#include "pool.h"
+
+#define NOBJECTS 1000
+#define NHANDOFF 8
+
+static my_pool * handoffPool;
+static void * handoff[NHANDOFF];
+
+/*
+ * A consumer that only frees objects another thread allocated, its magazine
+ * is returned to the pool when it exits
+ */
+static void * consume(void * unused) {
+  (void) unused;
+  for (int i = 0; i < NHANDOFF; i++) {
+    my_pool_free(handoffPool, handoff[i]);
+  }
+  return NULL;
+}
+
+static bool on_freelist(my_pool * pool, void * p) {
+  for (pool_object * obj = pool->freelist; obj; obj = obj->next) {
+    if (obj == p) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  my_pool * pool = my_pool_create(24, 32);
+  printf("created pool of %zu byte objects aligned to %zu\n",
+         pool->obj_size, pool->align);
+
+  void * objs[NOBJECTS];
+  bool aligned = true;
+  for (int i = 0; i < NOBJECTS; i++) {
+    objs[i] = my_pool_alloc(pool);
+    aligned = aligned && ((uintptr_t) objs[i] % 32) == 0;
+    memset(objs[i], i & 0xff, 24);
+  }
+  printf("allocated %d objects, all aligned: %s\n", NOBJECTS,
+         aligned ? "true" : "false");
+
+  bool intact = true;
+  for (int i = 0; i < NOBJECTS; i++) {
+    for (int j = 0; j < 24; j++) {
+      intact = intact && ((unsigned char *) objs[i])[j] == (i & 0xff);
+    }
+  }
+  printf("objects do not overlap: %s\n", intact ? "true" : "false");
+
+  void * last = objs[NOBJECTS - 1];
+  for (int i = 0; i < NOBJECTS; i++) {
+    my_pool_free(pool, objs[i]);
+  }
+  printf("freed %d objects, most recently freed reused: %s\n", NOBJECTS,
+         my_pool_alloc(pool) == last ? "true" : "false");
+
+  handoffPool = my_pool_create(24, 8);
+  for (int i = 0; i < NHANDOFF; i++) {
+    handoff[i] = my_pool_alloc(handoffPool);
+  }
+  pthread_t consumer;
+  pthread_create(&consumer, NULL, consume, NULL);
+  pthread_join(consumer, NULL);
+  bool returned = true;
+  for (int i = 0; i < NHANDOFF; i++) {
+    returned = returned && on_freelist(handoffPool, handoff[i]);
+  }
+  printf("objects freed by an exited thread returned to the pool: %s\n",
+         returned ? "true" : "false");
+
+  printf("invalid alignment rejected: %s\n",
+         my_pool_create(24, 24) == NULL ? "true" : "false");
+  puts("");
+
+  finalize_test();
+}
@@ -0,0 +1,31 @@
+#include "testing.h"
+
+#define NALLOCS 10
+
+int main() {
+  initialize_test(__FILE__);
+  void * ptrs[NALLOCS];
+
+  // Freed blocks are held in the quick lists without being coalesced
+  mallocing_loop(ptrs, 8, NALLOCS, print_status, false);
+  freeing_loop(ptrs, 8, NALLOCS, print_status, false);
+
+  // Allocating the same size pops the most recently freed block
+  ptrs[0] = mallocing(8, print_status, false);
+  freeing(ptrs[0], 8, print_status, false);
+
+  // A request too large for the freelists consolidates the quick lists
+  mallocing(900, print_status, false);
+
+  finalize_test();
+
+  // Freeing a block again after another block was pushed on top of it is
+  // still detected, the assertion message names a line of myMalloc.c so
+  // stderr is closed first
+  void * a = my_malloc(8);
+  void * b = my_malloc(8);
+  my_free(a);
+  my_free(b);
+  fclose(stderr);
+  my_free(a);
+}
@@ -0,0 +1,69 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "testing.h"
+#include "scratch.h"
+
+/*
+ * Allocate a buffer on the calling thread's stack and report where it went
+ */
+static void * thread_buffer(void * arg) {
+  (void) arg;
+  return my_scratch_alloc(64);
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  void * outer = my_scratch_mark();
+  char * a = my_scratch_alloc(10);
+  char * b = my_scratch_alloc(20);
+  printf("allocations are bumped from the top: %s\n", b == a + 16 ? "true" : "false");
+  printf("allocations are aligned: %s\n",
+         (uintptr_t) a % SCRATCH_ALIGNMENT == 0 && (uintptr_t) b % SCRATCH_ALIGNMENT == 0
+             ? "true" : "false");
+
+  void * inner = my_scratch_mark();
+  char * c = my_scratch_alloc(100);
+  memset(c, 'c', 100);
+  my_scratch_release(inner);
+  printf("releasing the inner mark reuses its memory: %s\n",
+         my_scratch_alloc(1) == c ? "true" : "false");
+  my_scratch_release(outer);
+  printf("releasing the outer mark reuses all of it: %s\n",
+         my_scratch_alloc(1) == a ? "true" : "false");
+  my_scratch_release(outer);
+  puts("");
+
+  // Larger than the committed part of the region, which grows to fit
+  size_t big = 4 * SCRATCH_COMMIT_SIZE + 1;
+  char * d = my_scratch_alloc(big);
+  memset(d, 'd', big);
+  printf("a %zu byte allocation grows the region: %s\n", big, d ? "true" : "false");
+  my_scratch_release(outer);
+
+  void * top = my_scratch_mark();
+  void * too_big = my_scratch_alloc(SCRATCH_RESERVE_SIZE + 1);
+  printf("an allocation larger than the region fails with ENOMEM: %s\n",
+         !too_big && errno == ENOMEM ? "true" : "false");
+  printf("a failed allocation leaves the top alone: %s\n",
+         my_scratch_mark() == top ? "true" : "false");
+  puts("");
+
+  pthread_t thread;
+  void * theirs;
+  pthread_create(&thread, NULL, thread_buffer, NULL);
+  pthread_join(thread, &theirs);
+  void * mine = my_scratch_alloc(64);
+  printf("threads have stacks of their own: %s\n",
+         theirs && mine && ((char *) theirs < (char *) mine ||
+                            (char *) theirs >= (char *) mine + SCRATCH_RESERVE_SIZE)
+             ? "true" : "false");
+  my_scratch_release(outer);
+  puts("");
+
+  finalize_test();
+}
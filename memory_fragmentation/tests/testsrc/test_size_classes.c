@@ -0,0 +1,47 @@
+#include <stdio.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+/*
+ * Free blocks spanning the linear and the geometric size classes, each kept
+ * apart from the next by a small allocation so they are not coalesced
+ */
+static size_t sizes[] = { 200, 488, 600, 700, 900, 1500, 3000, 6000 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+int main() {
+  initialize_test(__FILE__);
+
+  void * blocks[NSIZES];
+  void * spacers[NSIZES];
+  for (size_t i = 0; i < NSIZES; i++) {
+    blocks[i] = mallocing(sizes[i], print_status, true);
+    spacers[i] = mallocing(8, print_status, true);
+  }
+  for (size_t i = 0; i < NSIZES; i++) {
+    freeing(blocks[i], sizes[i], print_status, true);
+  }
+
+  printf("Each block is kept in the list for its size class\n");
+  freelist_print(print_object);
+  puts("");
+
+  printf("A 672 byte block skips the 640 to 767 byte list as not every block there fits\n");
+  void * p = mallocing(650, print_status, false);
+  freelist_print(print_status);
+  puts("");
+
+  printf("A 512 byte block fits anything in the 512 to 639 byte list\n");
+  void * q = mallocing(496, print_status, false);
+  freelist_print(print_status);
+  puts("");
+
+  freeing(p, 650, print_status, true);
+  freeing(q, 496, print_status, true);
+  for (size_t i = 0; i < NSIZES; i++) {
+    freeing(spacers[i], 8, print_status, true);
+  }
+
+  finalize_test();
+}
@@ -0,0 +1,61 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+#define TAG_LEXER 1
+#define TAG_PARSER 2
+#define TAG_HISTORY 3
+
+int main() {
+  initialize_test(__FILE__);
+
+  my_malloc_tag_name(TAG_LEXER, "lexer");
+  my_malloc_tag_name(TAG_PARSER, "parser");
+  my_malloc_tag_name(TAG_HISTORY, "history");
+
+  char * token = my_malloc_tagged(24, TAG_LEXER);
+  char * tree[3];
+  for (int i = 0; i < 3; i++) {
+    tree[i] = my_malloc_tagged(40, TAG_PARSER);
+  }
+  char * plain = my_malloc(40);
+  memset(token, 't', 24);
+  printf("a tagged block is as usable as an untagged one: %s\n",
+         my_malloc_usable_size(token) >= 24 && my_malloc_usable_size(tree[0]) >= 40
+             ? "true" : "false");
+  tag_stats_print();
+  puts("");
+
+  printf("Freeing two parser blocks\n");
+  my_free(tree[0]);
+  my_free(tree[1]);
+  tag_stats_print();
+  puts("");
+
+  printf("Growing the lexer block keeps its tag and contents\n");
+  token = my_realloc(token, 200);
+  printf("contents kept: %s\n", token[0] == 't' && token[23] == 't' ? "true" : "false");
+  tag_stats_print();
+  puts("");
+
+  printf("Freeing everything\n");
+  my_free(token);
+  my_free(tree[2]);
+  my_free(plain);
+  tag_stats_print();
+  printf("heap valid: %s\n", verify() ? "true" : "false");
+  puts("");
+
+  tag_stats stats;
+  my_malloc_tag_stats(0, &stats);
+  printf("untagged memory is not counted: %s\n",
+         stats.total_allocations == 0 ? "true" : "false");
+  void * bad = my_malloc_tagged(8, MAX_TAGS);
+  printf("a tag out of range fails with EINVAL: %s\n",
+         !bad && errno == EINVAL ? "true" : "false");
+
+  finalize_test();
+}
@@ -0,0 +1,73 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "myMalloc.h"
+#include "pool.h"
+#include "testing.h"
+
+static my_pool * pool;
+static pthread_barrier_t barrier;
+
+/*
+ * Write the thread_caches member of my_malloc_info
+ */
+static void print_thread_caches() {
+  char * info;
+  size_t len;
+  FILE * out = open_memstream(&info, &len);
+  my_malloc_info(out);
+  fclose(out);
+  char * start = strstr(info, "  \"thread_caches\"");
+  char * end = strstr(info, "  \"tags\"");
+  printf("%.*s\n", (int) (end - start), start);
+  free(info);
+}
+
+/*
+ * Fills caches of its own and waits while the main thread reports them
+ */
+static void * run(void * unused) {
+  (void) unused;
+  void * a = my_malloc(40);
+  void * b = my_malloc(40);
+  void * objects[3];
+  for (int i = 0; i < 3; i++) {
+    objects[i] = my_pool_alloc(pool);
+  }
+  my_pool_free(pool, objects[0]);
+
+  pthread_barrier_wait(&barrier);
+  pthread_barrier_wait(&barrier);
+
+  my_pool_free(pool, objects[1]);
+  my_pool_free(pool, objects[2]);
+  my_free(b);
+  my_free(a);
+  return NULL;
+}
+
+int main() {
+  initialize_test(__FILE__);
+
+  pool = my_pool_create(24, 0);
+  void * a = my_malloc(8);
+  void * p = my_pool_alloc(pool);
+
+  pthread_barrier_init(&barrier, NULL, 2);
+  pthread_t thread;
+  pthread_create(&thread, NULL, run, NULL);
+  pthread_barrier_wait(&barrier);
+  puts("while another thread holds caches:");
+  print_thread_caches();
+  pthread_barrier_wait(&barrier);
+  pthread_join(thread, NULL);
+  puts("after it exits:");
+  print_thread_caches();
+  pthread_barrier_destroy(&barrier);
+
+  my_pool_free(pool, p);
+  my_free(a);
+  finalize_test();
+}
@@ -0,0 +1,61 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testing.h"
+
+#define NTHREADS 8
+#define OPS 20000
+#define LIVE 128
+
+/*
+ * Each thread keeps LIVE blocks of mixed sizes alive, filling each block
+ * with its own pattern and checking it is intact before freeing it
+ */
+static void * churn(void * arg) {
+  unsigned int seed = (unsigned int) (long) arg;
+  unsigned char * live[LIVE] = {0};
+  size_t sizes[LIVE] = {0};
+  long corrupted = 0;
+
+  for (int i = 0; i < OPS; i++) {
+    int slot = rand_r(&seed) % LIVE;
+    if (live[slot]) {
+      for (size_t j = 0; j < sizes[slot]; j++) {
+        corrupted += live[slot][j] != (unsigned char) slot;
+      }
+      my_free(live[slot]);
+    }
+    // Mostly small sizes that hit the exact fit lists with some large ones
+    sizes[slot] = rand_r(&seed) % 4 ? 8 + 8 * (rand_r(&seed) % 16)
+                                     : rand_r(&seed) % 2048 + 1;
+    live[slot] = my_malloc(sizes[slot]);
+    memset(live[slot], slot, sizes[slot]);
+  }
+
+  for (int i = 0; i < LIVE; i++) {
+    my_free(live[i]);
+  }
+  return (void *) corrupted;
+}
+
+int main() {
+  printf("TEST: test_threads.c\n");
+
+  pthread_t threads[NTHREADS];
+  for (long t = 0; t < NTHREADS; t++) {
+    pthread_create(&threads[t], NULL, churn, (void *) (t + 1));
+  }
+
+  long corrupted = 0;
+  for (int t = 0; t < NTHREADS; t++) {
+    void * ret;
+    pthread_join(threads[t], &ret);
+    corrupted += (long) ret;
+  }
+
+  printf("%d threads performed %d operations each\n", NTHREADS, OPS);
+  printf("corrupted bytes: %ld\n", corrupted);
+  printf("heap valid: %s\n", verify() ? "true" : "false");
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+int main() {
+  initialize_test(__FILE__);
+
+  size_t sizes[] = { 1, 8, 17, 100 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    void * p = my_malloc(sizes[i]);
+    printf("my_malloc(%zu) has %zu usable bytes\n", sizes[i], my_malloc_usable_size(p));
+    my_free(p);
+  }
+  printf("NULL has %zu usable bytes\n", my_malloc_usable_size(NULL));
+  puts("");
+
+  // A free 120 byte block between an allocated block and the fencepost
+  void * p = mallocing(100, print_status, true);
+  void * spacer = mallocing(8, print_status, true);
+  freeing(p, 100, print_status, true);
+
+  printf("Too little of the block would be left to split it off\n");
+  size_t actual;
+  char * s = my_malloc_at_least(88, &actual);
+  printf("my_malloc_at_least(88) returned %zu usable bytes\n", actual);
+  tags_print(print_status);
+  puts("");
+
+  printf("Growing into the slack keeps the block\n");
+  memset(s, 's', actual);
+  printf("same block: %s\n", my_realloc(s, actual) == s ? "true" : "false");
+  printf("Growing past it moves the block\n");
+  char * t = my_realloc(s, actual + 1);
+  printf("same block: %s, contents kept: %s\n", t == s ? "true" : "false",
+         t[0] == 's' && t[actual - 1] == 's' ? "true" : "false");
+  printf("Reallocating to 0 bytes frees the block\n");
+  printf("returned NULL: %s\n", my_realloc(t, 0) == NULL ? "true" : "false");
+  tags_print(print_status);
+  puts("");
+
+  freeing(spacer, 8, print_status, true);
+
+  finalize_test();
+}
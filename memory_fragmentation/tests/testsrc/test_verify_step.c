@@ -0,0 +1,86 @@
+#include <stdio.h>
+
+#include "myMalloc.h"
+#include "testing.h"
+
+static size_t passes() {
+  alloc_stats stats;
+  my_malloc_stats(&stats);
+  return stats.verify_passes;
+}
+
+/*
+ * Verify budget blocks at a time until a pass over the heap completes or
+ * corruption is found, printing how many calls it took
+ */
+static void step_until_pass(size_t budget) {
+  size_t start = passes();
+  size_t calls = 0;
+  bool valid = true;
+  while (valid && passes() == start) {
+    fflush(stdout);
+    valid = my_verify_step(budget);
+    calls++;
+  }
+  printf("budget %zu: %s after %zu calls\n", budget,
+         valid ? "pass completed" : "corruption found", calls);
+}
+
+static header * to_header(void * p) {
+  return (header *) ((char *) p - ALLOC_HEADER_SIZE);
+}
+
+int main() {
+  setvbuf(stdout, NULL, _IONBF, 0);
+  initialize_test(__FILE__);
+
+  void * ptrs[8];
+  mallocing_loop(ptrs, 8, 8, print_status, false);
+  for (int i = 0; i < 8; i += 2) {
+    freeing(ptrs[i], 8, print_status, false);
+  }
+  puts("");
+
+  printf("An empty budget does no work: %s\n",
+         my_verify_step(0) && passes() == 0 ? "true" : "false");
+  step_until_pass(1);
+  step_until_pass(4);
+  step_until_pass(1000);
+  puts("");
+
+  printf("Coalescing the blocks around the cursor keeps it on a block\n");
+  my_verify_step(4);
+  for (int i = 1; i < 8; i += 2) {
+    freeing(ptrs[i], 8, print_status, false);
+    my_verify_step(1);
+  }
+  step_until_pass(2);
+  puts("");
+
+  void * a = mallocing(8, print_status, false);
+  void * b = mallocing(8, print_status, false);
+  void * c = mallocing(8, print_status, false);
+  freeing(b, 8, print_status, false);
+
+  printf("Corrupting a free block's next pointer\n");
+  header * free_block = to_header(b);
+  header * saved = free_block->next;
+  free_block->next = to_header(a);
+  step_until_pass(3);
+  free_block->next = saved;
+  step_until_pass(3);
+  puts("");
+
+  printf("Corrupting the size of an allocated block\n");
+  header * allocated = to_header(c);
+  allocated->size_state += 8;
+  step_until_pass(3);
+  allocated->size_state -= 8;
+  step_until_pass(3);
+  puts("");
+
+  freeing(a, 8, print_status, false);
+  freeing(c, 8, print_status, false);
+
+  finalize_test();
+}
@@ -0,0 +1,24 @@
+#!/bin/bash
+#
+# Commands per second the shell launches when running `true` in a loop, once
+# with every command forked and once with posix_spawn
+#
+# Usage: bench/launch.sh [commands]
+
+n=${1:-2000}
+cd "$(dirname "$0")/.." || exit 1
+
+input=$(mktemp)
+trap 'rm -f "$input"' EXIT
+for ((i = 0; i < n; i++)); do
+  echo true
+done > "$input"
+
+printf "%-8s %10s %14s\n" "method" "commands" "commands/sec"
+for method in fork spawn; do
+  start=$(date +%s.%N)
+  SHELL_LAUNCH=$method ./shell < "$input" > /dev/null
+  end=$(date +%s.%N)
+  awk -v m="$method" -v n="$n" -v s="$start" -v e="$end" \
+    'BEGIN { printf "%-8s %10d %14.0f\n", m, n, n / (e - s) }'
+done
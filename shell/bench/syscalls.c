@@ -0,0 +1,81 @@
+/*
+ * Count the system calls a command and every process it starts make
+ *
+ * Usage: bench/syscalls command [arguments]
+ *
+ * Prints the total number of system calls followed by the number of execve
+ * calls, failed ones included. Counting uses ptrace, so strace does not
+ * need to be installed.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TRACE_OPTIONS (PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | \
+                       PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE | \
+                       PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL)
+
+int main(int argc, char ** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s command [arguments]\n", argv[0]);
+    return 2;
+  }
+
+  pid_t child = fork();
+  if (child == 0) {
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    raise(SIGSTOP);
+    execvp(argv[1], argv + 1);
+    perror("execvp");
+    _exit(127);
+  }
+
+  int status;
+  waitpid(child, &status, 0);
+  if (ptrace(PTRACE_SETOPTIONS, child, NULL, TRACE_OPTIONS)) {
+    perror("ptrace");
+    return 1;
+  }
+  ptrace(PTRACE_SYSCALL, child, NULL, NULL);
+
+  unsigned long syscalls = 0;
+  unsigned long execs = 0;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, __WALL)) > 0) {
+    if (!WIFSTOPPED(status)) {
+      continue;
+    }
+
+    int sig = WSTOPSIG(status);
+    if (sig == (SIGTRAP | 0x80)) {
+      // Entry and exit stops look the same, the info tells them apart
+      struct __ptrace_syscall_info info;
+      ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info);
+      if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+        syscalls++;
+        execs += info.entry.nr == SYS_execve;
+      }
+      sig = 0;
+    }
+    else if (sig == SIGTRAP || (status >> 16) != 0 || sig == SIGSTOP) {
+      // ptrace events and the stop every new tracee starts in
+      sig = 0;
+    }
+    ptrace(PTRACE_SYSCALL, pid, NULL, sig);
+  }
+  if (errno != ECHILD) {
+    perror("waitpid");
+    return 1;
+  }
+
+  printf("%lu %lu\n", syscalls, execs);
+  return 0;
+}
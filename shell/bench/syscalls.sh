@@ -0,0 +1,26 @@
+#!/bin/bash
+#
+# System calls per launched command when running `true` in a loop, with the
+# command hash table off and on. The shell is traced once with no commands
+# and once with n of them, the difference divided by n is the cost of a
+# command. Counts include the children.
+#
+# Usage: bench/syscalls.sh [commands]
+
+n=${1:-500}
+cd "$(dirname "$0")/.." || exit 1
+
+empty=$(mktemp)
+input=$(mktemp)
+trap 'rm -f "$empty" "$input"' EXIT
+for ((i = 0; i < n; i++)); do
+  echo true
+done > "$input"
+
+printf "%-6s %10s %18s %16s\n" "hash" "commands" "syscalls/command" "execve/command"
+for hash in off on; do
+  read -r base_calls base_execs < <(SHELL_HASH=$hash ./bench/syscalls ./shell < "$empty" 2> /dev/null)
+  read -r calls execs < <(SHELL_HASH=$hash ./bench/syscalls ./shell < "$input" 2> /dev/null)
+  awk -v h="$hash" -v n="$n" -v c="$((calls - base_calls))" -v e="$((execs - base_execs))" \
+    'BEGIN { printf "%-6s %10d %18.1f %16.1f\n", h, n, c / n, e / n }'
+done
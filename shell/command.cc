@@ -15,6 +15,7 @@
  * MAY FACILITATE ACADEMIC DISHONESTY.
  */
 
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -22,11 +23,13 @@
 #include <iostream>
 
 #include "command.hh"
+#include "commandHash.hh"
 #include "shell.hh"
 #include "unistd.h"
 #include "sys/wait.h"
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <spawn.h>
 
 extern char **environ;
 
@@ -116,9 +119,8 @@ void Command::execute() {
     }
 
     // Add execution here
-    // For every simple command fork a new process
-    // Setup i/o redirection
-    // and call exec
+    // For every simple command setup i/o redirection
+    // and launch a new process
     int tmpin = dup(0);
     int tmpout = dup(1);
     int tmperr = dup(2);
@@ -132,7 +134,6 @@ void Command::execute() {
     int ret;
     int fdout;
     int fderr;
-    unsigned int q;
 
     for (unsigned int i = 0; i < _simpleCommands.size(); i++) {
       if (isatty(0)) {
@@ -175,7 +176,7 @@ void Command::execute() {
       dup2(fdout, 1);
       dup2(fderr, 2);
       close(fdout);
-      if (_errFile && !_outFile) {
+      if (fderr != fdout) {
         close(fderr);
       }
 
@@ -186,6 +187,9 @@ void Command::execute() {
       /* Set environment variable */
       if (!strcmp((char *)_simpleCommands[i]->_arguments[0]->c_str(), "setenv")) {
         setenv((char *)_simpleCommands[i]->_arguments[1]->c_str(), (char *)_simpleCommands[i]->_arguments[2]->c_str(), 1);
+        if (*_simpleCommands[i]->_arguments[1] == "PATH") {
+          CommandHash::clear();
+        }
         clear();
         if (isatty(0)) {
           printf("\n");
@@ -197,6 +201,9 @@ void Command::execute() {
       /* Unset environment variable */
       if (!strcmp((char *)_simpleCommands[i]->_arguments[0]->c_str(), "unsetenv")) {
         unsetenv((char *)_simpleCommands[i]->_arguments[1]->c_str());
+        if (*_simpleCommands[i]->_arguments[1] == "PATH") {
+          CommandHash::clear();
+        }
         clear();
         if (isatty(0)) {
           printf("\n");
@@ -225,34 +232,32 @@ void Command::execute() {
         return;
       }
 
-      ret = fork();
-      if (ret == 0) {
-        char **args =  (char **)malloc((_simpleCommands[i]->_arguments.size() + 1) * sizeof(char *));
-        for (q = 0; q < _simpleCommands[i]->_arguments.size(); q++) {
-          args[q] = (char *) _simpleCommands[i]->_arguments[q]->c_str();
-        }
-        args[q] = NULL;
-
-        /* Print environment variable */
-        if (strcmp(args[0], "printenv") == 0) {
-          int count = 0;
-          while (environ[count]) {
-            printf("%s\n", environ[count]);
-            count++;
-          }
-          exit(1);
-        }
-
-        execvp(args[0], args);
+      /* Show or clear the command hash table */
+      if (!strcmp(_simpleCommands[i]->_arguments[0]->c_str(), "hash")) {
+        int status = CommandHash::builtin(_simpleCommands[i]->_arguments);
+        fflush(stdout);
+        dup2(tmpin, 0);
+        dup2(tmpout, 1);
+        dup2(tmperr, 2);
+        close(tmpin);
+        close(tmpout);
+        close(tmperr);
+        setenv("?", std::to_string(status).c_str(), 1);
+        clear();
         if (isatty(0)) {
-          perror("execvp");
+          Shell::prompt();
         }
-        exit(1);
-      }
-      else if (ret < 0) {
-        perror("fork");
         return;
       }
+
+      // The child gets the descriptors wired up above as 0, 1 and 2, the
+      // saved descriptors and the read end of the next stage's pipe are
+      // closed in it
+      std::vector<int> closeInChild = {tmpin, tmpout, tmperr};
+      if (i < _simpleCommands.size() - 1) {
+        closeInChild.push_back(fdin);
+      }
+      ret = launch(_simpleCommands[i], closeInChild);
     }
     dup2(tmpin, 0);
     dup2(tmpout, 1);
@@ -261,7 +266,11 @@ void Command::execute() {
     close(tmpout);
     close(tmperr);
 
-    if (!_background) {
+    if (ret < 0) {
+      // The last command could not be started
+      setenv("?", "1", 1);
+    }
+    else if (!_background) {
       int stat;
       waitpid(ret, &stat, 0);
       std::string highlight = std::to_string(WEXITSTATUS(stat));
@@ -285,4 +294,85 @@ void Command::execute() {
     }
 }
 
+/*
+ * Start a simple command with the standard descriptors the shell has wired
+ * up for it. External commands are started with posix_spawnp, which glibc
+ * implements with clone(CLONE_VM|CLONE_VFORK), so the shell's page tables are
+ * never copied however large its heap. Only printenv, which runs shell code
+ * in the child, still forks. Setting SHELL_LAUNCH=fork forks for every
+ * command.
+ *
+ * Commands found in the hash table are launched from the path cached there
+ * without searching PATH again, the rest are searched for by execvp.
+ *
+ * Returns the pid of the child or -1 if it could not be started.
+ */
+pid_t Command::launch( SimpleCommand * simpleCommand,
+                       const std::vector<int> & closeInChild ) {
+    std::vector<char *> args;
+    for (auto & argument : simpleCommand->_arguments) {
+      args.push_back((char *) argument->c_str());
+    }
+    args.push_back(NULL);
+
+    const char *method = getenv("SHELL_LAUNCH");
+    bool forkChild = !strcmp(args[0], "printenv") ||
+                     (method && !strcmp(method, "fork"));
+
+    const char *path = CommandHash::lookup(args[0]);
+
+    pid_t pid;
+    if (!forkChild) {
+      posix_spawn_file_actions_t actions;
+      posix_spawn_file_actions_init(&actions);
+      for (int fd : closeInChild) {
+        posix_spawn_file_actions_addclose(&actions, fd);
+      }
+      int err = path ?
+        posix_spawn(&pid, path, &actions, NULL, args.data(), environ) :
+        posix_spawnp(&pid, args[0], &actions, NULL, args.data(), environ);
+      posix_spawn_file_actions_destroy(&actions);
+      if (err != 0) {
+        if (isatty(0)) {
+          errno = err;
+          perror("posix_spawnp");
+        }
+        return -1;
+      }
+      return pid;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+      for (int fd : closeInChild) {
+        close(fd);
+      }
+
+      /* Print environment variable */
+      if (strcmp(args[0], "printenv") == 0) {
+        int count = 0;
+        while (environ[count]) {
+          printf("%s\n", environ[count]);
+          count++;
+        }
+        exit(1);
+      }
+
+      if (path) {
+        execv(path, args.data());
+      }
+      else {
+        execvp(args[0], args.data());
+      }
+      if (isatty(0)) {
+        perror("execvp");
+      }
+      exit(1);
+    }
+    else if (pid < 0) {
+      perror("fork");
+    }
+    return pid;
+}
+
 SimpleCommand * Command::_currentSimpleCommand;
@@ -17,6 +17,8 @@
 #ifndef command_hh
 #define command_hh
 
+#include <sys/types.h>
+
 #include "simpleCommand.hh"
 
 // Command Data Structure
@@ -36,6 +38,9 @@ struct Command {
   void print();
   void execute();
 
+  static pid_t launch( SimpleCommand * simpleCommand,
+                       const std::vector<int> & closeInChild );
+
   static SimpleCommand *_currentSimpleCommand;
 };
 
@@ -0,0 +1,234 @@
+/*
+ * Command hash table
+ *
+ * execvp searches PATH for every command it runs, with one failed execve per
+ * directory before the one that holds the command. The shell instead
+ * resolves a name once and launches the absolute path it cached. Keeping
+ * the table right does not cost a system call per command either. The
+ * inotify descriptor watching PATH raises SIGIO when something changed and
+ * events are only read after that.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "commandHash.hh"
+
+// Changes that can make a name resolve differently
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                      IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+struct HashEntry {
+  std::string path;
+  unsigned int hits;
+};
+
+static std::unordered_map<std::string, HashEntry> table;
+
+// The inotify descriptor watching PATH, or -1 when nothing is cached
+static int inotifyFd = -1;
+static bool watching = false;
+static volatile sig_atomic_t pathChanged = 0;
+
+static void pathChangedHandler( int sig ) {
+  (void) sig;
+  pathChanged = 1;
+}
+
+/*
+ * The directories in PATH in search order. An unset PATH is searched the
+ * way execvp searches it.
+ */
+static std::vector<std::string> pathDirectories() {
+  std::string path;
+  const char *env = getenv("PATH");
+  if (env) {
+    path = env;
+  }
+  else {
+    size_t len = confstr(_CS_PATH, NULL, 0);
+    path.resize(len);
+    confstr(_CS_PATH, &path[0], len);
+    path.resize(len - 1);
+  }
+
+  std::vector<std::string> dirs;
+  size_t start = 0;
+  while (true) {
+    size_t end = path.find(':', start);
+    dirs.push_back(path.substr(start, end - start));
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+  return dirs;
+}
+
+/*
+ * Watch every directory in PATH. Caching is left off if inotify is not
+ * available since nothing would tell the table it went stale.
+ */
+static void watchPath() {
+  watching = true;
+  inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotifyFd < 0) {
+    return;
+  }
+
+  struct sigaction sa;
+  sa.sa_handler = pathChangedHandler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  if (sigaction(SIGIO, &sa, NULL) ||
+      fcntl(inotifyFd, F_SETOWN, getpid()) ||
+      fcntl(inotifyFd, F_SETFL, fcntl(inotifyFd, F_GETFL) | O_ASYNC)) {
+    close(inotifyFd);
+    inotifyFd = -1;
+    return;
+  }
+
+  for (auto & dir : pathDirectories()) {
+    if (!dir.empty() && dir[0] == '/') {
+      // Directories that do not exist are skipped like execvp skips them
+      inotify_add_watch(inotifyFd, dir.c_str(), WATCH_EVENTS);
+    }
+  }
+}
+
+/*
+ * Drop every name an event was queued for. A PATH directory that went away
+ * or an overflowed queue empties the table.
+ */
+static void readEvents() {
+  alignas(struct inotify_event) char buf[4096];
+  ssize_t n;
+  while ((n = read(inotifyFd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + n; ) {
+      struct inotify_event *event = (struct inotify_event *) p;
+      if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+        CommandHash::clear();
+        return;
+      }
+      if (event->len) {
+        table.erase(event->name);
+      }
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+}
+
+/*
+ * Search PATH for name the way execvp does. Returns NULL if it is not found
+ * or if a relative directory comes first, since what that holds depends on
+ * the current directory.
+ */
+static HashEntry * find( const char * name ) {
+  if (pathChanged) {
+    pathChanged = 0;
+    readEvents();
+  }
+  if (!watching) {
+    watchPath();
+  }
+  if (inotifyFd < 0) {
+    return NULL;
+  }
+
+  auto it = table.find(name);
+  if (it != table.end()) {
+    return &it->second;
+  }
+
+  for (auto & dir : pathDirectories()) {
+    if (dir.empty() || dir[0] != '/') {
+      return NULL;
+    }
+    std::string path = dir + "/" + name;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+        access(path.c_str(), X_OK) == 0) {
+      HashEntry & entry = table[name];
+      entry.path = path;
+      entry.hits = 0;
+      return &entry;
+    }
+  }
+  return NULL;
+}
+
+const char * CommandHash::lookup( const char * name ) {
+  // Names with a slash are not searched for
+  if (!*name || strchr(name, '/')) {
+    return NULL;
+  }
+  const char *hash = getenv("SHELL_HASH");
+  if (hash && !strcmp(hash, "off")) {
+    return NULL;
+  }
+
+  HashEntry *entry = find(name);
+  if (!entry) {
+    return NULL;
+  }
+  entry->hits++;
+  return entry->path.c_str();
+}
+
+void CommandHash::clear() {
+  table.clear();
+  if (inotifyFd >= 0) {
+    close(inotifyFd);
+    inotifyFd = -1;
+  }
+  watching = false;
+  pathChanged = 0;
+}
+
+/*
+ * hash            list the table with how often each command was launched
+ * hash -r         forget every command
+ * hash name ...   look up each name and add it to the table
+ *
+ * Returns the exit status of the builtin.
+ */
+int CommandHash::builtin( const std::vector<std::string *> & arguments ) {
+  if (arguments.size() == 1) {
+    if (table.empty()) {
+      printf("hash: hash table empty\n");
+      return 0;
+    }
+    printf("hits\tcommand\n");
+    for (auto & entry : table) {
+      printf("%4u\t%s\n", entry.second.hits, entry.second.path.c_str());
+    }
+    return 0;
+  }
+
+  if (*arguments[1] == "-r") {
+    clear();
+    return 0;
+  }
+
+  int status = 0;
+  for (size_t i = 1; i < arguments.size(); i++) {
+    const char *name = arguments[i]->c_str();
+    if (strchr(name, '/')) {
+      continue;
+    }
+    if (!find(name)) {
+      fprintf(stderr, "hash: %s: not found\n", name);
+      status = 1;
+    }
+  }
+  return status;
+}
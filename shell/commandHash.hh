@@ -0,0 +1,28 @@
+#ifndef commandhash_hh
+#define commandhash_hh
+
+#include <string>
+#include <vector>
+
+// Command Hash Table
+//
+// Maps command names to the absolute path PATH resolves them to, so a
+// command is searched for once instead of by every launch. The directories
+// in PATH are watched with inotify and a name is dropped from the table when
+// an entry of that name is created, removed, renamed or has its mode changed
+// in any of them.
+
+struct CommandHash {
+
+  // The absolute path name resolves to, or NULL if it should be left to
+  // execvp to search for
+  static const char * lookup( const char * name );
+
+  // Forget every command and stop watching PATH
+  static void clear();
+
+  // The hash builtin
+  static int builtin( const std::vector<std::string *> & arguments );
+};
+
+#endif